@@ -0,0 +1,337 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+ansi.c: drawing with ANSI escape sequences instead of curses
+*/
+
+#include "columns.h"
+
+#include <errno.h>
+#include <termios.h>
+
+/*
+	The screen is kept twice: back is what it should look like, front
+is what the terminal is showing. Drawing only changes back. ansiflush()
+goes through both looking for differences and puts everything needed to
+fix them (cursor movements and characters) into one buffer, which goes
+to the terminal in a single write(). Only lines where something in back
+has changed get looked at.
+
+	Short gaps between changed characters on the same line are
+rewritten rather than jumped over, since a cursor movement takes at
+least 4 bytes.
+*/
+
+#define MAX_GAP 4
+
+#define ESC_WAIT 50000000LL /* ns to wait for the rest of an arrow key */
+
+static int outfd = -1;
+static int infd = -1;
+static int israw = 0;
+static struct termios oldtermios;
+
+static int rows;
+static int cols;
+static char *front = NULL;
+static char *back = NULL;
+static char *changedrows = NULL;
+
+static char *out = NULL;  /* what ansiflush() is about to write */
+static size_t outlen;
+static size_t outsize;
+
+static int lost = 0;      /* out couldn't hold everything emitted */
+static long long written; /* bytes sent to the terminal so far */
+
+static int currow = -1;   /* where the terminal's cursor is */
+static int curcol = -1;
+
+static char keybuf[64];   /* bytes read but not turned into keys yet */
+static size_t keylen;
+static long long escsince; /* when the start of an arrow key, with the
+                              rest not read yet, was first held back
+                              (monotime()), or 0 */
+
+static void emit(const char *s, size_t n)
+{
+	if (outlen + n > outsize)
+	{
+		char *bigger;
+		size_t newsize = outsize * 2 + n + 256;
+
+		if ((bigger = realloc(out, newsize)) == NULL)
+		{
+			lost = 1; /* see ansiflush() */
+			return;
+		}
+		out = bigger;
+		outsize = newsize;
+	}
+	(void)memcpy(out + outlen, s, n);
+	outlen += n;
+}
+
+static void emitstr(const char *s)
+{
+	emit(s, strlen(s));
+}
+
+/* write everything in out to the terminal */
+static void writeout(void)
+{
+	size_t done = 0;
+
+	while (done < outlen)
+	{
+		ssize_t n = write(outfd, out + done, outlen - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += (size_t)n;
+	}
+	written += (long long)done;
+	outlen = 0;
+}
+
+/* start drawing to the terminal on ofd and reading keys from ifd
+   (which can be -1 for no keys); return 0 if that's not possible */
+int ansistart(int ifd, int ofd)
+{
+	struct winsize ws;
+	int r = 24, c = 80;
+
+	infd = ifd;
+	outfd = ofd;
+
+	if (infd >= 0 && isatty(infd) && tcgetattr(infd, &oldtermios) == 0)
+	{
+		struct termios t = oldtermios;
+
+		/* like cbreak() and noecho(): keys come in one at a time
+		   and don't appear on the screen */
+		t.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+		t.c_iflag &= ~(tcflag_t)(ICRNL | IXON);
+		t.c_cc[VMIN] = 0;
+		t.c_cc[VTIME] = 0;
+		if (tcsetattr(infd, TCSAFLUSH, &t) == 0)
+			israw = 1;
+	}
+
+	if (ioctl(outfd, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0)
+	{
+		r = ws.ws_row;
+		c = ws.ws_col;
+	}
+
+	/* the alternate screen, with no cursor */
+	emitstr("\033[?1049h\033[?25l");
+	ansiresize(r, c);
+	return front != NULL;
+}
+
+/* give the terminal back the way it was */
+void ansiend(void)
+{
+	emitstr("\033[?25h\033[?1049l");
+	writeout();
+
+	if (israw)
+		(void)tcsetattr(infd, TCSAFLUSH, &oldtermios);
+	israw = 0;
+}
+
+/* the terminal is now r rows by c columns; start from a blank screen */
+void ansiresize(int r, int c)
+{
+	free(front);
+	free(back);
+	free(changedrows);
+	rows = r;
+	cols = c;
+	front = malloc((size_t)(rows * cols));
+	back  = malloc((size_t)(rows * cols));
+	changedrows = calloc((size_t)rows, 1);
+	if (front == NULL || back == NULL || changedrows == NULL)
+	{
+		rows = cols = 0;
+		return;
+	}
+	(void)memset(front, ' ', (size_t)(rows * cols));
+	(void)memset(back,  ' ', (size_t)(rows * cols));
+
+	emitstr("\033[H\033[2J");
+	currow = curcol = 0;
+}
+
+int ansirows(void)
+{
+	return rows;
+}
+
+int ansicols(void)
+{
+	return cols;
+}
+
+long long ansibytes(void)
+{
+	return written;
+}
+
+void ansiput(int row, int col, char ch)
+{
+	if (row >= 0 && row < rows && col >= 0 && col < cols)
+	{
+		back[row * cols + col] = ch;
+		changedrows[row] = 1;
+	}
+}
+
+/* like erase(): the whole screen is to be blank */
+void ansiclear(void)
+{
+	(void)memset(back, ' ', (size_t)(rows * cols));
+	(void)memset(changedrows, 1, (size_t)rows);
+}
+
+/* send the terminal whatever it takes to show what's in back */
+void ansiflush(void)
+{
+	char move[32];
+	int r, c;
+
+	for (r = 0; r < rows; r++)
+	{
+		const char *f = front + r * cols;
+		const char *b = back  + r * cols;
+
+		if (!changedrows[r])
+			continue;
+		changedrows[r] = 0;
+
+		for (c = 0; c < cols; c++)
+		{
+			if (f[c] == b[c])
+				continue;
+
+			if (r == currow && c >= curcol && c - curcol <= MAX_GAP)
+				emit(b + curcol, (size_t)(c - curcol));
+			else
+			{
+				(void)snprintf(move, sizeof move, "\033[%d;%dH",
+					r + 1, c + 1);
+				emitstr(move);
+			}
+			emit(b + c, 1);
+			currow = r;
+			curcol = c + 1;
+		}
+		(void)memcpy(front + r * cols, b, (size_t)cols);
+	}
+
+	/* with some of it missing, what's in out would leave the screen
+	   wrong in ways there's no knowing; send none of it, and have the
+	   next flush send everything, wherever the cursor is */
+	if (lost)
+	{
+		(void)memset(front, '\0', (size_t)(rows * cols));
+		(void)memset(changedrows, 1, (size_t)rows);
+		currow = curcol = -1;
+		outlen = 0;
+		lost = 0;
+		return;
+	}
+
+	if (outlen > 0)
+		writeout();
+}
+
+/* read keys from ifd with ansikey(), without drawing anything; for
+   curses, whose getch() can't run while the render thread draws */
+void ansikeys(int ifd)
+{
+	infd = ifd;
+	keylen = 0;
+	escsince = 0;
+}
+
+/* 1 if keybuf starts with what could still become an arrow key */
+static int partialkey(void)
+{
+	return keybuf[0] == '\033' && (keylen == 1
+		|| (keylen == 2 && (keybuf[1] == '[' || keybuf[1] == 'O')));
+}
+
+/* the next key pressed, as getch() would return it in keypad mode, or
+   ERR if there isn't one yet */
+int ansikey(void)
+{
+	struct pollfd pfd;
+	ssize_t n;
+	int ch, ended = 0;
+
+	if (infd < 0)
+		return ERR;
+
+	/* curses leaves reads blocking until a key comes */
+	pfd.fd = infd;
+	pfd.events = POLLIN;
+	if (keylen < sizeof keybuf && poll(&pfd, 1, 0) > 0)
+	{
+		n = read(infd, keybuf + keylen, sizeof keybuf - keylen);
+		if (n > 0)
+			keylen += (size_t)n;
+		else
+			ended = 1; /* the rest of an arrow key isn't coming */
+	}
+	if (keylen == 0)
+		return ERR;
+
+	/* an arrow key split between reads: hold on to the start of it
+	   for a while, rather than take it for an Escape */
+	if (partialkey() && !ended)
+	{
+		if (escsince == 0)
+			escsince = monotime();
+		if (monotime() - escsince < ESC_WAIT)
+			return ERR;
+	}
+	escsince = 0;
+
+	ch = (unsigned char)keybuf[0];
+	n = 1;
+
+	/* arrow keys are ESC [ A (or ESC O A) through ESC [ D */
+	if (ch == '\033' && keylen >= 3
+		&& (keybuf[1] == '[' || keybuf[1] == 'O'))
+	{
+		n = 3;
+		switch (keybuf[2])
+		{
+		case 'A': ch = KEY_UP;    break;
+		case 'B': ch = KEY_DOWN;  break;
+		case 'C': ch = KEY_RIGHT; break;
+		case 'D': ch = KEY_LEFT;  break;
+		default:  ch = '\033';    break;
+		}
+	}
+
+	keylen -= (size_t)n;
+	(void)memmove(keybuf, keybuf + n, keylen);
+	return ch;
+}
+
+/* how many ms until ansikey() gives up on the rest of an arrow key and
+   returns what it has, or -1 if it isn't waiting for one */
+int ansikeywait(void)
+{
+	long long left;
+
+	if (escsince == 0)
+		return -1;
+	left = escsince + ESC_WAIT - monotime();
+	return left > 0 ? (int)((left + 999999) / 1000000) : 0;
+}
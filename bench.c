@@ -0,0 +1,534 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+bench.c: timing the game's inner loops
+
+Prints one line per measurement, "name board value unit", so results
+from different versions can be compared with diff, sort, awk and such.
+*/
+
+#include "columns.h"
+
+#include <stdio.h>
+
+#define MIN_NS 200000000L /* run each measurement for at least 0.2 s */
+
+#define HUGE_WIDTH  1024  /* for benchhuge() */
+#define HUGE_HEIGHT 1024
+
+typedef struct
+{
+	const char *name;
+	int width;
+	int height;
+	int fill;    /* percent of rows, from the bottom, with blocks */
+	int matches; /* 0 to avoid runs of three when filling */
+} board_t;
+
+static board_t boards[] =
+{
+	{ "empty",      DEF_WIDTH, DEF_HEIGHT,   0, 0 },
+	{ "sparse",     DEF_WIDTH, DEF_HEIGHT,  25, 0 },
+	{ "dense",      DEF_WIDTH, DEF_HEIGHT,  80, 0 },
+	{ "cascade",    DEF_WIDTH, DEF_HEIGHT,  80, 1 },
+	{ "max",        MAX_WIDTH, MAX_HEIGHT,  80, 0 },
+	{ "maxcascade", MAX_WIDTH, MAX_HEIGHT,  80, 1 }
+};
+
+#define NUMBOARDS ((int)(sizeof boards / sizeof boards[0]))
+
+static game_t *games[NUMBOARDS];
+
+static game_t *scratch; /* with room for the biggest of them */
+static unsigned long benchrng = 1;
+
+static unsigned long benchrandom(void)
+{
+	benchrng = benchrng * 6364136223846793005UL + 1442695040888963407UL;
+	return benchrng >> 33;
+}
+
+static long nanotime(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* would putting ch at row, col make a run of three with what's
+   already below and to the left of it? */
+static int makesrun(const game_t *g, int row, int col, char ch)
+{
+	static const int dirs[4][2] = { {0, -1}, {1, 0}, {1, -1}, {1, 1} };
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		int dr = dirs[i][0], dc = dirs[i][1];
+
+		if (blockat(g, row + dr, col + dc) == ch
+			&& blockat(g, row + 2*dr, col + 2*dc) == ch)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* a board with its bottom rows filled with random blocks, or NULL if
+   there isn't memory for it */
+static game_t *makeboard(const board_t *b)
+{
+	int rows = b->height * b->fill / 100;
+	game_t *g;
+	int r, c;
+
+	if ((g = startgame(b->width, b->height, 1)) == NULL)
+		return NULL;
+	for (r = 0; r < HIDDEN_ROWS; r++) /* lose the falling blocks */
+		setblock(g, r, g->fallcol, ' ');
+
+	for (r = g->height - 1; r >= g->height - rows; r--)
+	for (c = 0; c < g->width; c++)
+	{
+		char ch;
+
+		do
+			ch = CH_BLOCKS[1 + benchrandom() % NUMBLOCKS];
+		while (!b->matches && makesrun(g, r, c, ch));
+		setblock(g, r, c, ch);
+	}
+
+	/* have findmatches() look at every cell */
+	changeall(g);
+	return g;
+}
+
+/*
+	Each kernel gets a fresh copy of its board every time it runs, and
+the time that copying takes is measured on its own and subtracted.
+*/
+
+typedef void (*kernel_t)(game_t *g);
+
+static void k_copy(game_t *g)
+{
+	(void)g;
+}
+
+static void k_findmatches(game_t *g)
+{
+	(void)findmatches(g);
+}
+
+static void k_findmatchesfrom(game_t *g)
+{
+	int r, c;
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+	for (c = 0; c < g->width; c++)
+		(void)findmatchesfrom(g, r, c);
+}
+
+static void k_destroyblinkers(game_t *g)
+{
+	destroyblinkers(g);
+}
+
+static void k_enforcegravity(game_t *g)
+{
+	compactcolumns(g);
+	while (enforcegravity(g))
+		;
+}
+
+static void k_drawscreen(game_t *g)
+{
+	drawscreen(g);
+}
+
+/* what the copy of a board looks like when a kernel gets it */
+typedef void (*setup_t)(game_t *g);
+
+static void s_none(game_t *g)
+{
+	(void)g;
+}
+
+/* matches found and blinking */
+static void s_blinking(game_t *g)
+{
+	(void)findmatches(g);
+}
+
+/* matches destroyed and waiting to fall */
+static void s_destroyed(game_t *g)
+{
+	(void)findmatches(g);
+	destroyblinkers(g);
+}
+
+/* all blocks to be drawn, on a screen with borders for this board, so
+   that only its own cells are drawn */
+static void s_undrawn(game_t *g)
+{
+	drawborders(g->width, g->height - HIDDEN_ROWS);
+	touchall(g);
+}
+
+/* the same board with all its blocks gone, so that drawing it after
+   the original has something to change */
+static void s_blank(game_t *g)
+{
+	int r, c;
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+	for (c = 0; c < g->width; c++)
+		setblock(g, r, c, ' ');
+	touchall(g);
+}
+
+/* run kernel on copies of a and b, alternately, until MIN_NS has
+   passed; return the average ns per run, copying included */
+static double timekernel(const game_t *a, const game_t *b, kernel_t kernel)
+{
+	long n, i, t0, t;
+
+	for (n = 16; ; n *= 2)
+	{
+		t0 = nanotime();
+		for (i = 0; i < n; i++)
+		{
+			copygame(scratch, (i & 1) ? b : a);
+			kernel(scratch);
+		}
+		t = nanotime() - t0;
+		if (t >= MIN_NS)
+			break;
+	}
+
+	return (double)t / (double)n;
+}
+
+/* time kernel on every board, set up with seta and setb (for
+   alternate runs); with perop, report the time per cell; with
+   runsonly, skip the boards filled without runs of three, where
+   there's nothing for kernel to do */
+static void bench(const char *name, kernel_t kernel, setup_t seta,
+	setup_t setb, int perop, int runsonly)
+{
+	game_t *a, *b;
+	int i;
+
+	for (i = 0; i < NUMBOARDS; i++)
+	{
+		double ns;
+
+		if (games[i] == NULL || (runsonly && !boards[i].matches))
+			continue;
+		if ((a = dupgame(games[i])) == NULL
+			|| (b = dupgame(games[i])) == NULL)
+		{
+			free(a);
+			continue;
+		}
+		seta(a);
+		setb(b);
+
+		ns = timekernel(a, b, kernel) - timekernel(a, b, k_copy);
+		free(a);
+		free(b);
+		if (ns < 0)
+			ns = 0;
+		if (perop)
+			ns /= (double)(boards[i].width * boards[i].height);
+
+		(void)printf("%s %s %.1f ns/op\n", name, boards[i].name, ns);
+		(void)fflush(stdout);
+	}
+}
+
+/* how many whole games a second the engine can play, with inputs
+   chosen at random */
+static void benchgames(void)
+{
+	long t0, t;
+	long games = 0;
+	long ticks = 0;
+	game_t *g;
+
+	t0 = nanotime();
+	do
+	{
+		if ((g = startgame(DEF_WIDTH, DEF_HEIGHT,
+			(unsigned long)games)) == NULL)
+		{
+			return;
+		}
+		g->quickgravity = 1;
+		while (g->state != STATE_GAMEOVER)
+		{
+			if (g->state == STATE_FALL && benchrandom() % 2 == 0)
+				(void)gameinput(g,
+					(gameinput_t)(benchrandom() % 4));
+			gametick(g);
+		}
+		ticks += g->ticks;
+		games++;
+		endgame(g);
+		t = nanotime() - t0;
+	} while (t < 5 * MIN_NS);
+
+	(void)printf("games default %.1f games/s\n",
+		(double)games * 1e9 / (double)t);
+	(void)printf("ticks default %.1f ns/op\n", (double)t / (double)ticks);
+}
+
+/* how many visible cells CHANGED(g) has, which is what findmatches()
+   looks through */
+static int changedcells(const game_t *g)
+{
+	int n = 0;
+	int r;
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+		n += __builtin_popcountll(CHANGED(g)[r]);
+	return n;
+}
+
+/* how many changed cells findmatches() has to look through when a 1x3
+   block lands, over whole games played as in benchgames(); only the
+   block itself should count, or findmatches() goes over the whole
+   playfield instead of the few lines through it, so return 0 if any
+   landing has more than three */
+static int benchlandings(void)
+{
+	long landings = 0;
+	long cells = 0;
+	int most = 0;
+	game_t *g;
+	int i;
+
+	for (i = 0; i < 100; i++)
+	{
+		if ((g = startgame(DEF_WIDTH, DEF_HEIGHT,
+			(unsigned long)i)) == NULL)
+		{
+			break;
+		}
+		g->quickgravity = 1;
+		while (g->state != STATE_GAMEOVER)
+		{
+			long pieces = g->pieces;
+			int n;
+
+			if (g->state != STATE_FALL)
+			{
+				gametick(g);
+				continue;
+			}
+			if (benchrandom() % 2 == 0)
+				(void)gameinput(g,
+					(gameinput_t)(benchrandom() % 4));
+			n = changedcells(g);
+			gametick(g);
+			if (g->state == STATE_FALL && g->pieces == pieces)
+				continue; /* still falling */
+			landings++;
+			cells += n;
+			if (n > most)
+				most = n;
+		}
+		endgame(g);
+	}
+
+	(void)printf("changed-at-landing default %.2f cells/op\n",
+		(double)cells / (double)landings);
+	(void)printf("changed-at-landing-max default %d cells\n", most);
+	if (most > 3)
+	{
+		(void)fprintf(stderr, "columns-bench: %d changed cells at a "
+			"landing; findmatches() rescans\n", most);
+		return 0;
+	}
+	return 1;
+}
+
+/* trying out a move for a default game's falling block and going
+   back, the two ways a search can: with a snapshot, undoing the
+   changes made since, and by playing on a copy of the game; the game
+   is a few blocks in, so the moves have something to land on */
+static void benchtryouts(void)
+{
+	game_t *g, *kept, *copy;
+	snapshot_t before;
+	undo_t undo;
+	move_t mv;
+	long n, i, t0, t;
+	int way;
+
+	if ((g = startgame(DEF_WIDTH, DEF_HEIGHT, 1)) == NULL)
+		return;
+	g->quickgravity = 1;
+	for (i = 0; i < 12 && g->state != STATE_GAMEOVER; i++)
+	{
+		mv.col = (int)(i % DEF_WIDTH);
+		mv.shuffles = (int)(i % 3);
+		playmove(g, &mv);
+	}
+	if ((kept = dupgame(g)) == NULL || (copy = dupgame(g)) == NULL)
+	{
+		free(kept);
+		endgame(g);
+		return;
+	}
+	(void)memset(&undo, 0, sizeof undo);
+	keepchanges(kept, &undo);
+
+	for (way = 0; way < 2; way++)
+	{
+		for (n = 1; ; n *= 2)
+		{
+			t0 = nanotime();
+			for (i = 0; i < n; i++)
+			{
+				mv.col = (int)(i / 3 % DEF_WIDTH);
+				mv.shuffles = (int)(i % 3);
+				if (way == 0)
+				{
+					savegame(kept, &before);
+					playmove(kept, &mv);
+					(void)restoregame(kept, &before);
+				}
+				else
+				{
+					copygame(copy, g);
+					playmove(copy, &mv);
+				}
+			}
+			t = nanotime() - t0;
+			if (t >= MIN_NS)
+				break;
+		}
+		(void)printf("%s default %.1f ns/op\n",
+			way == 0 ? "tryout-undo" : "tryout-copy",
+			(double)t / (double)n);
+	}
+
+	freeundo(&undo);
+	free(copy);
+	free(kept);
+	endgame(g);
+}
+
+/* findmatches() over the whole of a huge playfield, with 1 to 8
+   threads; big playfields can't be copied the way bench() does, so
+   this times changeall() and findmatches() together, then
+   changeall() alone */
+static void benchhugematches(void)
+{
+	static const board_t huge =
+		{ "huge", HUGE_WIDTH, HUGE_HEIGHT, 80, 0 };
+	long n, i, t0, t, tall, tchange;
+	game_t *g;
+
+	if ((g = makeboard(&huge)) == NULL)
+		return;
+
+	for (g->threads = 1; g->threads <= 8; g->threads *= 2)
+	{
+		for (n = 1; ; n *= 2)
+		{
+			t0 = nanotime();
+			for (i = 0; i < n; i++)
+			{
+				changeall(g);
+				(void)findmatches(g);
+			}
+			tall = nanotime() - t0;
+			t0 = nanotime();
+			for (i = 0; i < n; i++)
+				changeall(g);
+			tchange = nanotime() - t0;
+			if (tall >= MIN_NS)
+				break;
+		}
+		t = tall - tchange;
+		(void)printf("findmatches-%dthreads huge %.1f ns/op\n",
+			g->threads, (double)(t < 0 ? 0 : t) / (double)n);
+		(void)fflush(stdout);
+	}
+	endgame(g);
+}
+
+/* the same on a playfield much bigger than MAX_WIDTH by MAX_HEIGHT,
+   which big.c looks after; one game is plenty */
+static void benchhuge(void)
+{
+	long t0, t;
+	game_t *g;
+
+	if ((g = startgame(HUGE_WIDTH, HUGE_HEIGHT, 1)) == NULL)
+		return;
+	g->quickgravity = 1;
+	benchrng = 1; /* the same game whatever ran before */
+
+	t0 = nanotime();
+	do
+	{
+		if (g->state == STATE_FALL && benchrandom() % 2 == 0)
+			(void)gameinput(g, (gameinput_t)(benchrandom() % 4));
+		gametick(g);
+		t = nanotime() - t0;
+	} while (g->state != STATE_GAMEOVER && t < 5 * MIN_NS);
+
+	(void)printf("ticks huge %.1f ns/op\n", (double)t / (double)g->ticks);
+	endgame(g);
+}
+
+int main(void)
+{
+	FILE *devnull;
+	int i;
+
+	(void)printf("# columns-bench: name board value unit\n");
+
+	for (i = 0; i < NUMBOARDS; i++)
+		games[i] = makeboard(&boards[i]);
+	if ((scratch = malloc(gamesize(MAX_WIDTH, MAX_HEIGHT))) == NULL)
+		return 1;
+
+	bench("findmatches", k_findmatches, s_none, s_none, 0, 0);
+	bench("findmatchesfrom", k_findmatchesfrom, s_none, s_none, 1, 0);
+	bench("destroyblinkers", k_destroyblinkers,
+		s_blinking, s_blinking, 0, 1);
+	bench("enforcegravity", k_enforcegravity,
+		s_destroyed, s_destroyed, 0, 1);
+
+	/* draw to a terminal nobody sees; ANSI is enough for curses to
+	   work out what to send */
+	if ((devnull = fopen("/dev/null", "w")) != NULL
+		&& newterm("ansi", devnull, stdin) != NULL)
+	{
+		(void)resizeterm(MAX_HEIGHT + 2,
+			MAX_WIDTH*2 + (2+PANEL_WIDTH)*2);
+		bench("drawscreen", k_drawscreen, s_undrawn, s_blank, 0, 0);
+		(void)endwin();
+	}
+
+	/* and again with ansi.c */
+	if (devnull != NULL)
+	{
+		benchscreen(fileno(devnull));
+		resizescreen(MAX_HEIGHT + 2, MAX_WIDTH*2 + (2+PANEL_WIDTH)*2);
+		bench("drawscreen-ansi", k_drawscreen, s_undrawn, s_blank, 0, 0);
+		endscreen();
+	}
+
+	benchhugematches();
+	benchgames();
+	benchtryouts();
+	benchhuge();
+
+	return benchlandings() ? 0 : 1;
+}
@@ -0,0 +1,799 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+big.c: playfields too big for game_t's arrays
+*/
+
+#include "game.h"
+#include "pool.h"
+
+/*
+	A big playfield is cut into tiles of TILE by TILE cells, each one
+a block of memory of its own holding the tile's cells (packed as with
+PACKEDCELLS), its bit planes and which of its cells have changed. The
+neighbours of a cell are nearly always in the same tile, so working on
+one part of the playfield touches a few tiles rather than a few rows
+thousands of cells long.
+
+	Nothing here goes over the whole playfield. Each tile keeps count
+of its changed and blinking cells, and the tiles where there are any
+are listed, so finding matches, destroying them and making blinking
+blocks blink only visit those. Each column keeps the lowest row a
+block was destroyed in, so gravity starts there, and each tile counts
+the blocks in each of its columns, so gravity skips empty stretches a
+tile at a time, and of each type, so a %%% block landing only visits
+the tiles with blocks of the type it landed on.
+*/
+
+#define TILE 64
+
+/* a cell's flags, above its CELL_TYPE bits */
+#define CELL_BLINK 0x08
+#define CELL_CLEAN 0x10 /* drawn since it last changed */
+
+/* which of a tile's changedrows[] */
+#define ALL_COLS   0 /* changed cells anywhere */
+#define LEFT_COLS  1 /* in the two columns at the left */
+#define RIGHT_COLS 2 /* in the two at the right */
+
+typedef struct
+{
+	unsigned char cells[TILE][TILE];
+	uint64_t planes[BLOCKTYPES][TILE];
+	uint64_t changed[TILE];
+	uint64_t changedrows[3];        /* rows with any, as bits */
+	unsigned short colblocks[TILE]; /* blocks in each column */
+	unsigned short typeblocks[BLOCKTYPES]; /* and of each type */
+	int numchanged;                 /* bits set in changed */
+	int isdirty;                    /* in the board's dirty list */
+	int blinkers;                   /* cells with CELL_BLINK */
+	uint64_t blinkrows;             /* rows where any of them are */
+	uint64_t found[TILE];           /* cells in runs (bandmatches()), */
+	uint64_t foundrows;             /* in these rows */
+	int listed;                     /* in bandmatches()'s list */
+} tile_t;
+
+/* a block that falls after blocks below it are destroyed (drop_t is
+   too small, but BIG_MAX fits in a short) */
+typedef struct
+{
+	unsigned short col;
+	unsigned short from;
+	unsigned short to;
+} bigdrop_t;
+
+struct bigboard
+{
+	int width;
+	int height;
+	int tilecols;
+	int tilerows;
+	tile_t *tiles;
+
+	int *dirty;        /* tiles with changed cells */
+	int numdirty;
+	int *blinky;       /* tiles with blinking cells */
+	int numblinky;
+
+	int *listed;       /* for bandmatches(): the tiles to look at, */
+	int *scan;         /* the same sorted into bands */
+	int *bandstart;    /* and where each band starts in scan */
+
+	int *colcount;     /* blocks in each column */
+	int *lowhole;      /* lowest row each column has had a block
+	                      destroyed in, or -1 */
+	int *holecols;     /* the columns that have */
+	int numholecols;
+
+	bigdrop_t *drops;  /* room for one per cell, which is as many as
+	                      there can be */
+	int numdrops;
+};
+
+/* a w by h playfield (hidden rows included), all empty */
+bigboard_t *newbig(int w, int h)
+{
+	bigboard_t *b;
+	int i, n;
+
+	if ((b = calloc(1, sizeof *b)) == NULL)
+		return NULL;
+	b->width    = w;
+	b->height   = h;
+	b->tilecols = (w + TILE - 1) / TILE;
+	b->tilerows = (h + TILE - 1) / TILE;
+	n = b->tilecols * b->tilerows;
+
+	b->tiles    = calloc((size_t)n, sizeof *b->tiles);
+	b->dirty    = malloc((size_t)n * sizeof *b->dirty);
+	b->blinky   = malloc((size_t)n * sizeof *b->blinky);
+	b->listed   = malloc((size_t)n * sizeof *b->listed);
+	b->scan     = malloc((size_t)n * sizeof *b->scan);
+	b->bandstart = malloc((size_t)(b->tilerows + 1) * sizeof *b->bandstart);
+	b->colcount = calloc((size_t)w, sizeof *b->colcount);
+	b->lowhole  = malloc((size_t)w * sizeof *b->lowhole);
+	b->holecols = malloc((size_t)w * sizeof *b->holecols);
+	b->drops    = malloc((size_t)w * (size_t)h * sizeof *b->drops);
+	if (b->tiles == NULL || b->dirty == NULL || b->blinky == NULL
+		|| b->listed == NULL || b->scan == NULL || b->bandstart == NULL
+		|| b->colcount == NULL || b->lowhole == NULL
+		|| b->holecols == NULL || b->drops == NULL)
+	{
+		freebig(b);
+		return NULL;
+	}
+
+	for (i = 0; i < w; i++)
+		b->lowhole[i] = -1;
+	return b;
+}
+
+void freebig(bigboard_t *b)
+{
+	free(b->tiles);
+	free(b->dirty);
+	free(b->blinky);
+	free(b->listed);
+	free(b->scan);
+	free(b->bandstart);
+	free(b->colcount);
+	free(b->lowhole);
+	free(b->holecols);
+	free(b->drops);
+	free(b);
+}
+
+static tile_t *tileof(bigboard_t *b, int row, int col)
+{
+	return &b->tiles[(row / TILE) * b->tilecols + col / TILE];
+}
+
+/* how many blocks there are in column col */
+int bigcolumn(const bigboard_t *b, int col)
+{
+	return b->colcount[col];
+}
+
+unsigned char *bigcell(bigboard_t *b, int row, int col)
+{
+	return &tileof(b, row, col)->cells[row % TILE][col % TILE];
+}
+
+/* the block at row, col is changing from type oldtype to newtype (-1
+   for none); put it in the cell, to be drawn, and keep the planes and
+   counts up to date */
+void bigput(bigboard_t *b, int row, int col, int oldtype, int newtype)
+{
+	tile_t *t = tileof(b, row, col);
+	int r = row % TILE, c = col % TILE;
+	uint64_t bit = (uint64_t)1 << c;
+
+	t->cells[r][c] = (unsigned char)
+		((t->cells[r][c] & CELL_BLINK) | (newtype + 1));
+
+	if (oldtype >= 0)
+	{
+		t->planes[oldtype][r] &= ~bit;
+		t->colblocks[c]--;
+		t->typeblocks[oldtype]--;
+		b->colcount[col]--;
+	}
+	if (newtype >= 0)
+	{
+		t->planes[newtype][r] |= bit;
+		t->colblocks[c]++;
+		t->typeblocks[newtype]++;
+		b->colcount[col]++;
+		if (!(t->changed[r] & bit))
+		{
+			t->changed[r] |= bit;
+			t->changedrows[ALL_COLS] |= (uint64_t)1 << r;
+			if (c < 2)
+				t->changedrows[LEFT_COLS] |= (uint64_t)1 << r;
+			if (c >= TILE - 2)
+				t->changedrows[RIGHT_COLS] |= (uint64_t)1 << r;
+			t->numchanged++;
+			if (!t->isdirty)
+			{
+				t->isdirty = 1;
+				b->dirty[b->numdirty++] = (int)(t - b->tiles);
+			}
+		}
+	}
+	else if (t->changed[r] & bit)
+	{
+		/* a space can't be part of a match; the tile stays listed
+		   until the next bigmatches(), with nothing to look at */
+		t->changed[r] &= ~bit;
+		t->numchanged--;
+		if (t->changed[r] == 0)
+			t->changedrows[ALL_COLS] &= ~((uint64_t)1 << r);
+		if (!(t->changed[r] & 3))
+			t->changedrows[LEFT_COLS] &= ~((uint64_t)1 << r);
+		if (!(t->changed[r] >> (TILE - 2)))
+			t->changedrows[RIGHT_COLS] &= ~((uint64_t)1 << r);
+	}
+}
+
+void bigblink(bigboard_t *b, int row, int col, int on)
+{
+	tile_t *t = tileof(b, row, col);
+	unsigned char *p = &t->cells[row % TILE][col % TILE];
+
+	if (on && !(*p & CELL_BLINK))
+	{
+		*p |= CELL_BLINK;
+		t->blinkrows |= (uint64_t)1 << (row % TILE);
+		if (t->blinkers++ == 0)
+			b->blinky[b->numblinky++] = (int)(t - b->tiles);
+	}
+	else if (!on && (*p & CELL_BLINK))
+	{
+		*p &= (unsigned char)~CELL_BLINK;
+		t->blinkers--;
+	}
+}
+
+int bigblinking(bigboard_t *b, int row, int col)
+{
+	return (*bigcell(b, row, col) & CELL_BLINK) != 0;
+}
+
+/* whether row, col has been drawn since it last changed */
+int bigclean(bigboard_t *b, int row, int col)
+{
+	return (*bigcell(b, row, col) & CELL_CLEAN) != 0;
+}
+
+void bigsetclean(bigboard_t *b, int row, int col, int on)
+{
+	unsigned char *p = bigcell(b, row, col);
+
+	if (on)
+		*p |= CELL_CLEAN;
+	else
+		*p &= (unsigned char)~CELL_CLEAN;
+}
+
+/* have every blinking block drawn again */
+void bigtouchblinkers(bigboard_t *b)
+{
+	int i, r, c;
+
+	for (i = 0; i < b->numblinky; i++)
+	{
+		tile_t *t = &b->tiles[b->blinky[i]];
+		uint64_t rows = t->blinkrows;
+
+		while (rows != 0)
+		{
+			r = __builtin_ctzll(rows);
+			rows &= rows - 1;
+			for (c = 0; c < TILE; c++)
+			{
+				if (t->cells[r][c] & CELL_BLINK)
+					t->cells[r][c] &=
+						(unsigned char)~CELL_CLEAN;
+			}
+		}
+	}
+}
+
+/* count every cell as changed */
+void bigchangeall(bigboard_t *b)
+{
+	int i, r;
+
+	b->numdirty = 0;
+	for (i = 0; i < b->tilecols * b->tilerows; i++)
+	{
+		tile_t *t = &b->tiles[i];
+		int rows = b->height - i / b->tilecols * TILE;
+		int cols = b->width - i % b->tilecols * TILE;
+		uint64_t m = cols >= TILE ? ~(uint64_t)0
+			: ((uint64_t)1 << cols) - 1;
+
+		t->numchanged = 0;
+		t->isdirty = 0;
+		(void)memset(t->changedrows, 0, sizeof t->changedrows);
+		for (r = 0; r < TILE && r < rows; r++)
+		{
+			t->changed[r] = m;
+			t->numchanged += __builtin_popcountll(m);
+			t->changedrows[ALL_COLS] |= (uint64_t)1 << r;
+			if (m & 3)
+				t->changedrows[LEFT_COLS] |= (uint64_t)1 << r;
+			if (m >> (TILE - 2))
+				t->changedrows[RIGHT_COLS] |= (uint64_t)1 << r;
+		}
+		if (t->numchanged > 0)
+		{
+			t->isdirty = 1;
+			b->dirty[b->numdirty++] = i;
+		}
+	}
+}
+
+/* set row, col blinking; return 1 if it wasn't already */
+static int blink(bigboard_t *b, int row, int col)
+{
+	if (*bigcell(b, row, col) & CELL_BLINK)
+		return 0;
+	bigblink(b, row, col, 1);
+	return 1;
+}
+
+/* make every visible block of type t blink, from the bottom up until
+   they've all been found; return how many */
+int bigspecial(game_t *g, int t)
+{
+	bigboard_t *b = g->big;
+	int numfound = 0;
+	int left = g->typecount[t];
+	int i, r;
+
+	for (i = b->tilecols * b->tilerows - 1; i >= 0 && left > 0; i--)
+	{
+		const tile_t *tile = &b->tiles[i];
+		int row0 = i / b->tilecols * TILE, col0 = i % b->tilecols * TILE;
+
+		if (tile->typeblocks[t] == 0)
+			continue;
+		left -= tile->typeblocks[t];
+		for (r = 0; r < TILE; r++)
+		{
+			uint64_t m = tile->planes[t][r];
+
+			if (row0 + r < HIDDEN_ROWS)
+				continue;
+			while (m != 0)
+			{
+				int c = __builtin_ctzll(m);
+
+				m &= m - 1;
+				numfound += blink(b, row0 + r, col0 + c);
+			}
+		}
+	}
+	return numfound;
+}
+
+/* plane t of row, over the 64 columns of tile column tc moved along by
+   s (-2 to 2): bit c is column tc*TILE + c + s */
+static uint64_t shifted(const bigboard_t *b, int t, int row, int tc, int s)
+{
+	const tile_t *tile;
+	uint64_t w, side;
+
+	if (row < 0 || row >= b->height)
+		return 0;
+	tile = &b->tiles[(row / TILE) * b->tilecols + tc];
+	w = tile->planes[t][row % TILE];
+	if (s > 0)
+	{
+		side = tc + 1 < b->tilecols ? tile[1].planes[t][row % TILE] : 0;
+		return (w >> s) | (side << (64 - s));
+	}
+	if (s < 0)
+	{
+		side = tc > 0 ? tile[-1].planes[t][row % TILE] : 0;
+		return (w << -s) | (side >> (64 + s));
+	}
+	return w;
+}
+
+/* the cells in row with a run of three of type t through them in the
+   direction (dr, dc), if they were of type t themselves */
+static uint64_t runcells(const bigboard_t *b, int t, int row, int tc,
+	int dr, int dc)
+{
+	uint64_t m2 = shifted(b, t, row - 2*dr, tc, -2*dc);
+	uint64_t m1 = shifted(b, t, row - dr,   tc, -dc);
+	uint64_t p1 = shifted(b, t, row + dr,   tc, dc);
+	uint64_t p2 = shifted(b, t, row + 2*dr, tc, 2*dc);
+
+	return (m2 & m1) | (m1 & p1) | (p1 & p2);
+}
+
+/* the rows of the tile at tile row tr, tile column tc with changed
+   cells in cols (ALL_COLS and so on), as bits; none if there's no
+   such tile */
+static uint64_t changedrows(const bigboard_t *b, int tr, int tc, int cols)
+{
+	if (tr < 0 || tr >= b->tilerows || tc < 0 || tc >= b->tilecols)
+		return 0;
+	return b->tiles[tr * b->tilecols + tc].changedrows[cols];
+}
+
+/* rows, and the rows within two of them */
+static uint64_t spread(uint64_t rows)
+{
+	return rows | rows << 1 | rows << 2 | rows >> 1 | rows >> 2;
+}
+
+/* put the cells of tile i that are in a run of three into found, one
+   word a row, with bit planes the way bitboard.c does, except that
+   each cell looks at its own neighbours, in this tile or the next,
+   instead of each run marking its cells: that way nothing outside the
+   tile gets marked. Only the rows in near are looked at; return the
+   ones with cells in runs, which are the only ones set in found. */
+static uint64_t marktile(const bigboard_t *b, int i, uint64_t near,
+	uint64_t *found)
+{
+	const tile_t *tile = &b->tiles[i];
+	int tc = i % b->tilecols;
+	int row0 = i / b->tilecols * TILE;
+	uint64_t rows = 0;
+	int r, t;
+
+	for (; near != 0; near &= near - 1)
+	{
+		uint64_t m = 0;
+
+		r = row0 + __builtin_ctzll(near);
+		if (r < HIDDEN_ROWS || r >= b->height)
+			continue;
+		for (t = 0; t < BLOCKTYPES; t++)
+		{
+			uint64_t here = tile->planes[t][r % TILE];
+
+			if (here == 0)
+				continue;
+			m |= here & (runcells(b, t, r, tc, 0, 1)
+				| runcells(b, t, r, tc, 1, 0)
+				| runcells(b, t, r, tc, 1, 1)
+				| runcells(b, t, r, tc, 1, -1));
+		}
+		if (m != 0)
+		{
+			found[r % TILE] = m;
+			rows |= (uint64_t)1 << (r % TILE);
+		}
+	}
+	return rows;
+}
+
+/* set the cells in rows of found (from marktile()) blinking; return
+   how many weren't already */
+static int blinkfound(bigboard_t *b, int i, uint64_t rows,
+	const uint64_t *found)
+{
+	int row0 = i / b->tilecols * TILE;
+	int col0 = i % b->tilecols * TILE;
+	int numfound = 0;
+
+	for (; rows != 0; rows &= rows - 1)
+	{
+		int r = __builtin_ctzll(rows);
+		uint64_t m = found[r];
+
+		while (m != 0)
+		{
+			int c = __builtin_ctzll(m);
+
+			m &= m - 1;
+			numfound += blink(b, row0 + r, col0 + c);
+		}
+	}
+	return numfound;
+}
+
+/* set every block in tile i that is in a run of three blinking; only
+   rows within two of a changed cell in the tile can have a new run */
+static int scantile(bigboard_t *b, int i)
+{
+	uint64_t found[TILE];
+	uint64_t rows;
+
+	rows = marktile(b, i, spread(changedrows(b, i / b->tilecols,
+		i % b->tilecols, ALL_COLS)), found);
+	return blinkfound(b, i, rows, found);
+}
+
+/* the rows of tile i that a changed cell, in this tile or within two
+   of it in the ones around it, could have made part of a run */
+static uint64_t nearrows(const bigboard_t *b, int i)
+{
+	int tr = i / b->tilecols, tc = i % b->tilecols;
+	uint64_t near, above, below;
+
+	near = spread(changedrows(b, tr, tc - 1, RIGHT_COLS)
+		| changedrows(b, tr, tc, ALL_COLS)
+		| changedrows(b, tr, tc + 1, LEFT_COLS));
+	above = changedrows(b, tr - 1, tc - 1, RIGHT_COLS)
+		| changedrows(b, tr - 1, tc, ALL_COLS)
+		| changedrows(b, tr - 1, tc + 1, LEFT_COLS);
+	below = changedrows(b, tr + 1, tc - 1, RIGHT_COLS)
+		| changedrows(b, tr + 1, tc, ALL_COLS)
+		| changedrows(b, tr + 1, tc + 1, LEFT_COLS);
+	if (above >> (TILE - 2))
+		near |= 3;
+	if (below & 3)
+		near |= (uint64_t)3 << (TILE - 2);
+	return near;
+}
+
+/*
+	When there are plenty of tiles to look at, the playfield is split
+into bands a row of tiles high, and each of g->threads threads takes
+bands and marks the runs in their tiles. A cell's runs can reach
+two rows into the bands above and below (the halo), but those are only
+read; each tile's marks go into its own found, so no cell gets counted
+twice. Once every band is done, this thread sets the marked cells
+blinking, which gives the same blocks and the same count as looking
+one tile at a time. Even with one thread this beats looking from every
+changed cell near a tile's edge, as below, once many tiles have lots of
+changed cells.
+*/
+#define BAND_TILES 16
+
+static void scanband(long band, int worker, void *arg)
+{
+	bigboard_t *b = arg;
+	int j;
+
+	(void)worker;
+	for (j = b->bandstart[band]; j < b->bandstart[band + 1]; j++)
+	{
+		int i = b->scan[j];
+
+		b->tiles[i].foundrows = marktile(b, i, nearrows(b, i),
+			b->tiles[i].found);
+	}
+}
+
+/* findmatches() for a big playfield, spread over threads threads */
+static int bandmatches(bigboard_t *b, int threads)
+{
+	int numfound = 0;
+	int numlisted = 0;
+	int i, j, dr, dc;
+
+	/* every tile with a changed cell or one within two of it, listed
+	   once, then sorted into bands */
+	(void)memset(b->bandstart, 0,
+		(size_t)(b->tilerows + 1) * sizeof *b->bandstart);
+	for (i = 0; i < b->numdirty; i++)
+	for (dr = -1; dr <= 1; dr++)
+	for (dc = -1; dc <= 1; dc++)
+	{
+		const tile_t *d = &b->tiles[b->dirty[i]];
+		int tr = b->dirty[i] / b->tilecols + dr;
+		int tc = b->dirty[i] % b->tilecols + dc;
+		uint64_t rows;
+		tile_t *t;
+
+		if (tr < 0 || tr >= b->tilerows || tc < 0 || tc >= b->tilecols)
+			continue;
+		rows = d->changedrows[dc < 0 ? LEFT_COLS
+			: dc > 0 ? RIGHT_COLS : ALL_COLS];
+		if (dr < 0)
+			rows &= 3;
+		else if (dr > 0)
+			rows >>= TILE - 2;
+		if (rows == 0)
+			continue;
+		t = &b->tiles[tr * b->tilecols + tc];
+		if (t->listed)
+			continue;
+		t->listed = 1;
+		b->listed[numlisted++] = (int)(t - b->tiles);
+		b->bandstart[tr + 1]++;
+	}
+	for (i = 0; i < b->tilerows; i++)
+		b->bandstart[i + 1] += b->bandstart[i];
+	for (j = 0; j < numlisted; j++)
+	{
+		int tr = b->listed[j] / b->tilecols;
+
+		b->scan[b->bandstart[tr]++] = b->listed[j];
+	}
+	for (i = b->tilerows; i > 0; i--) /* each start moved to the next */
+		b->bandstart[i] = b->bandstart[i - 1];
+	b->bandstart[0] = 0;
+
+	(void)runpool(b->tilerows, threads, scanband, b);
+
+	for (j = 0; j < numlisted; j++)
+	{
+		tile_t *t = &b->tiles[b->scan[j]];
+
+		numfound += blinkfound(b, b->scan[j], t->foundrows, t->found);
+		t->listed = 0;
+	}
+	for (i = 0; i < b->numdirty; i++)
+	{
+		tile_t *t = &b->tiles[b->dirty[i]];
+
+		(void)memset(t->changed, 0, sizeof t->changed);
+		(void)memset(t->changedrows, 0, sizeof t->changedrows);
+		t->numchanged = 0;
+		t->isdirty = 0;
+	}
+	b->numdirty = 0;
+	return numfound;
+}
+
+/*
+	findmatches() for a big playfield: the same as for any other, but
+only in the tiles with changed cells. Where many cells in a tile have
+changed, the whole tile is scanned, and that finds the runs' blocks
+inside the tile; any run that goes on into the next tile has a changed
+cell within two of the edge (on one side or the other), and looking
+from that cell finds the rest.
+*/
+#define RESCAN_THRESHOLD 16
+
+int bigmatches(game_t *g)
+{
+	bigboard_t *b = g->big;
+	int numfound = 0;
+	int i, r;
+
+	if (b->numdirty >= BAND_TILES)
+	{
+		int dense = 0;
+
+		for (i = 0; i < b->numdirty; i++)
+			dense += b->tiles[b->dirty[i]].numchanged > RESCAN_THRESHOLD;
+		if (g->threads > 1 || dense >= BAND_TILES)
+			return bandmatches(b, g->threads);
+	}
+
+	for (i = 0; i < b->numdirty; i++)
+	{
+		tile_t *t = &b->tiles[b->dirty[i]];
+		int row0 = b->dirty[i] / b->tilecols * TILE;
+		int col0 = b->dirty[i] % b->tilecols * TILE;
+		int scan = t->numchanged > RESCAN_THRESHOLD;
+
+		if (scan)
+			numfound += scantile(b, b->dirty[i]);
+
+		for (r = 0; r < TILE; r++)
+		{
+			uint64_t m = t->changed[r];
+
+			t->changed[r] = 0;
+			if (row0 + r < HIDDEN_ROWS)
+				continue;
+			while (m != 0)
+			{
+				int c = __builtin_ctzll(m);
+
+				m &= m - 1;
+				if (!scan || r < 2 || r >= TILE - 2
+					|| c < 2 || c >= TILE - 2)
+				{
+					numfound += findmatchesfrom(g, row0 + r,
+						col0 + c);
+				}
+			}
+		}
+		(void)memset(t->changedrows, 0, sizeof t->changedrows);
+		t->numchanged = 0;
+		t->isdirty = 0;
+	}
+	b->numdirty = 0;
+	return numfound;
+}
+
+/* destroyblinkers() for a big playfield, without the scoring; return
+   how many blocks were destroyed */
+int bigdestroy(game_t *g)
+{
+	bigboard_t *b = g->big;
+	int numdest = 0;
+	int i, c;
+
+	for (i = 0; i < b->numblinky; i++)
+	{
+		int row0 = b->blinky[i] / b->tilecols * TILE;
+		int col0 = b->blinky[i] % b->tilecols * TILE;
+		tile_t *t = &b->tiles[b->blinky[i]];
+		uint64_t rows = t->blinkrows;
+
+		t->blinkrows = 0;
+		for (; rows != 0 && t->blinkers > 0; rows &= rows - 1)
+		{
+			int row = row0 + __builtin_ctzll(rows);
+
+			for (c = 0; c < TILE; c++)
+			{
+				int col = col0 + c;
+
+				if (!(t->cells[row % TILE][c] & CELL_BLINK))
+					continue;
+				bigblink(b, row, col, 0);
+				setblock(g, row, col, ' ');
+				numdest++;
+
+				if (b->lowhole[col] < 0)
+					b->holecols[b->numholecols++] = col;
+				if (row > b->lowhole[col])
+					b->lowhole[col] = row;
+			}
+		}
+	}
+	b->numblinky = 0;
+	return numdest;
+}
+
+/* list a drop; no block is listed twice, so there's always room */
+static void adddrop(bigboard_t *b, int col, int from, int to)
+{
+	bigdrop_t *d = &b->drops[b->numdrops++];
+
+	d->col  = (unsigned short)col;
+	d->from = (unsigned short)from;
+	d->to   = (unsigned short)to;
+}
+
+/* compactcolumns() for a big playfield: the blocks below the lowest
+   hole in a column stay put, so only the ones above it are looked at,
+   skipping stretches of a tile with none */
+void bigcompact(game_t *g)
+{
+	bigboard_t *b = g->big;
+	int i, r;
+
+	b->numdrops = 0;
+	for (i = 0; i < b->numholecols; i++)
+	{
+		int c = b->holecols[i];
+		int to = b->lowhole[c];
+
+		b->lowhole[c] = -1;
+		for (r = to - 1; r >= HIDDEN_ROWS; r--)
+		{
+			if (tileof(b, r, c)->colblocks[c % TILE] == 0)
+			{
+				r -= r % TILE; /* to the top of the tile */
+				continue;
+			}
+			if (!(*bigcell(b, r, c) & CELL_TYPE))
+				continue;
+			adddrop(b, c, r, to);
+			to--;
+		}
+	}
+	b->numholecols = 0;
+}
+
+/* enforcegravity() for a big playfield */
+int biggravity(game_t *g)
+{
+	bigboard_t *b = g->big;
+	int anymoved = 0;
+	int i;
+
+	for (i = 0; i < b->numdrops; i++)
+	{
+		const bigdrop_t *d = &b->drops[i];
+
+		if (d->to - d->from >= g->dropstep)
+		{
+			int row = d->from + g->dropstep - 1;
+
+			setblock(g, row + 1, d->col, blockat(g, row, d->col));
+			setblock(g, row, d->col, ' ');
+			anymoved = 1;
+		}
+	}
+	return anymoved;
+}
+
+/* collapsecolumns() for a big playfield */
+void bigcollapse(game_t *g)
+{
+	bigboard_t *b = g->big;
+	int i;
+
+	for (i = 0; i < b->numdrops; i++)
+	{
+		const bigdrop_t *d = &b->drops[i];
+
+		setblock(g, d->to, d->col, blockat(g, d->from, d->col));
+		setblock(g, d->from, d->col, ' ');
+	}
+}
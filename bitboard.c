@@ -0,0 +1,54 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+bitboard.c: finding matches a whole row of cells at a time
+*/
+
+#include "game.h"
+
+/*
+	A plane holds one bit per cell for a single type of block: bit c
+of plane[r] is set if the block at row r, column c is of that type.
+Bits beyond the width of the playfield are always clear, so nothing
+wraps around from one side to the other.
+
+	A run of three starting at bit c of row r is then just an AND of
+three shifted rows, and the cells in all runs of three or more are the
+union of those runs of three.
+*/
+
+/* OR into marks every cell in plane that is part of a horizontal,
+   vertical or diagonal run of three or more */
+void bbruns(const uint64_t *plane, int rows, uint64_t *marks)
+{
+	int r;
+	uint64_t t;
+
+	for (r = 0; r < rows; r++)
+	{
+		/* horizontal: columns c, c+1, c+2 */
+		t = plane[r] & (plane[r] >> 1) & (plane[r] >> 2);
+		marks[r] |= t | (t << 1) | (t << 2);
+
+		if (r + 2 >= rows)
+			continue;
+
+		/* vertical: rows r, r+1, r+2 */
+		t = plane[r] & plane[r+1] & plane[r+2];
+		marks[r]   |= t;
+		marks[r+1] |= t;
+		marks[r+2] |= t;
+
+		/* down and to the right: (r, c), (r+1, c+1), (r+2, c+2) */
+		t = plane[r] & (plane[r+1] >> 1) & (plane[r+2] >> 2);
+		marks[r]   |= t;
+		marks[r+1] |= t << 1;
+		marks[r+2] |= t << 2;
+
+		/* down and to the left: (r, c), (r+1, c-1), (r+2, c-2) */
+		t = plane[r] & (plane[r+1] << 1) & (plane[r+2] << 2);
+		marks[r]   |= t;
+		marks[r+1] |= t >> 1;
+		marks[r+2] |= t >> 2;
+	}
+}
@@ -8,12 +8,24 @@ columns.c: main program
 
 static char *endmsg = NULL;
 
-static void finish(int sig)
-{
-	sig = sig;
+static int fastplay = 0;   /* don't wait between ticks */
+static int playback = 0;   /* the inputs come from a replay */
+static int showtiming = 0; /* say how well the game kept time */
+static int instrument = 0; /* measure every frame and show it */
+static int botdepth = 0;   /* how far ahead the computer looks, if
+                              it's playing */
+static uint64_t botrng;    /* and random state of its own */
+
+static sched_t sched;
 
-	(void)curs_set(1); /* visible */
-	(void)endwin();
+/* put everything back and leave; not for signal handlers, since it
+   waits for the other threads */
+static void finish(void)
+{
+	stopinput();
+	stoprender();
+	endscreen();
+	TRACE_EXPORT();
 
 	(void)putchar('\n');
 	if (endmsg != NULL)
@@ -25,7 +37,7 @@ static void finish(int sig)
 static void die(char *s)
 {
 	endmsg = s;
-	finish(0);
+	finish();
 }
 
 void millisleep(int ms)
@@ -36,19 +48,429 @@ void millisleep(int ms)
 	(void)nanosleep(&tsp, NULL);
 }
 
+/*
+	Between ticks the game sleeps in poll() until a key is pressed,
+the window changes size or the timer for the next tick goes off, so
+keys are handled as soon as they arrive and nothing wakes up the rest
+of the time. The timer is a timerfd, and SIGWINCH and SIGINT are turned
+into something poll() can see by writing to a pipe. The handlers do
+nothing else: a SIGINT is just a quit, and the game ends as it would
+for q, with its replay finished and the threads stopped first.
+*/
+
+static int tickfd = -1;
+static int sigpipe[2] = { -1, -1 };
+static volatile sig_atomic_t interrupted = 0;
+
+static void winched(int sig)
+{
+	char c = 0;
+
+	(void)sig;
+	(void)write(sigpipe[1], &c, 1);
+}
+
+static void interrupt(int sig)
+{
+	interrupted = 1;
+	winched(sig);
+}
+
+static void setupevents(void)
+{
+	if ((tickfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+		die("Can't create a timer");
+	if (pipe(sigpipe) != 0)
+		die("Can't create a pipe");
+	(void)fcntl(sigpipe[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(sigpipe[1], F_SETFL, O_NONBLOCK);
+	(void)signal(SIGWINCH, winched);
+}
+
+/* have tickfd go off at when (monotime()) */
+static void settimer(long long when)
+{
+	struct itimerspec its;
+
+	(void)memset(&its, 0, sizeof its);
+	its.it_value.tv_sec  = (time_t)(when / 1000000000LL);
+	its.it_value.tv_nsec = (long)(when % 1000000000LL);
+	if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+		its.it_value.tv_nsec = 1; /* 0 would disarm it */
+	(void)timerfd_settime(tickfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* the terminal changed size; tell curses and draw everything again */
+static void resize(game_t *g)
+{
+	struct winsize ws;
+	char buf[64];
+
+	while (read(sigpipe[0], buf, sizeof buf) > 0)
+		;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+		resizescreen(ws.ws_row, ws.ws_col);
+	redrawscreen(g);
+}
+
+/*
+	With -i, every frame is measured: how long the tick took, how
+long drawing took, how many bytes it sent, and, for frames that show a
+key being pressed, how long it took from the key being seen to the
+screen showing what it did. The tick is timed here; the rest is timed
+by the render thread (see screen.c) as it draws. The medians go in the
+panel on the right, and everything is summed up at the end.
+*/
+
+/* have what's changed in g drawn */
+static void drawframe(game_t *g)
+{
+	TRACE_BEGIN("frame");
+	drawscreen(g);
+	TRACE_END("frame");
+}
+
+/* run a tick of g, measuring it if wanted */
+static void simframe(game_t *g)
+{
+	long long t0 = instrument ? monotime() : 0;
+
+	gametick(g);
+	if (instrument)
+		statadd(STAT_SIM, monotime() - t0);
+}
+
+/* the player does something; record it if a replay is being made */
+static int playinput(game_t *g, gameinput_t in)
+{
+	recordinput(g->ticks, in);
+	return gameinput(g, in);
+}
+
+/* the computer plays: as soon as a new 1x3 block appears, steer it
+   where lookahead() says. Looking more than two blocks ahead takes
+   long enough to be worth spreading over all the processors. */
+static void botmove(game_t *g)
+{
+	static long pieces = 0;
+	move_t m;
+	int i;
+
+	if (g->state != STATE_FALL || g->pieces == pieces)
+		return;
+	pieces = g->pieces;
+
+	lookahead(g, botdepth, botdepth > 2 ? numprocessors() : 1, &botrng,
+		&m);
+
+	for (i = 0; i < m.shuffles; i++)
+		(void)playinput(g, INPUT_SHUFFLE);
+	while (g->fallcol < m.col && playinput(g, INPUT_RIGHT))
+		;
+	while (g->fallcol > m.col && playinput(g, INPUT_LEFT))
+		;
+	drawframe(g);
+}
+
+/* wait for a key, which does nothing else, or for there to be no more
+   keys, or a SIGINT */
+static void pausegame(game_t *g)
+{
+	struct pollfd pfd[2];
+
+	pfd[0].fd = inputfd();
+	pfd[1].fd = sigpipe[0];
+	pfd[0].events = pfd[1].events = POLLIN;
+	while (keyat(0) == NULL && !inputgone() && !interrupted)
+	{
+		(void)poll(pfd, 2, -1);
+		clearinput();
+	}
+	if (keyat(0) != NULL)
+		takekeys(1);
+
+	schedresume(&sched, tickdelay(g));
+}
+
+/* the input a key steers the falling blocks with, or -1 if it doesn't */
+static int keyinput(int ch)
+{
+	if (ch == KEY_LEFT || ch == 'h')
+		return INPUT_LEFT;
+	if (ch == KEY_RIGHT || ch == 'l')
+		return INPUT_RIGHT;
+	if (ch == KEY_UP || ch == 'k')
+		return INPUT_SHUFFLE;
+	if (ch == KEY_DOWN || ch == 'j')
+		return INPUT_DOWN;
+	return -1;
+}
+
+/* if any key pressed before until is q, return 1; if one is p, forget
+   it and the keys before it, pause, and return -1 */
+static int quitorpause(game_t *g, long long until)
+{
+	keyevent_t *e;
+	int i;
+
+	for (i = 0; (e = keyat(i)) != NULL && e->when <= until; i++)
+	{
+		if (e->key == 'q')
+			return 1;
+		if (e->key == 'p')
+		{
+			takekeys(i + 1);
+			pausegame(g);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* handle the keys pressed before until (monotime()), which is when the
+   next tick is due, in the order they were pressed; return 1 if the
+   player wants to quit. The falling blocks can only be steered while
+   they're falling, and not during a replay. Keys to steer them pressed
+   while blocks are blinking or falling into place are kept for the
+   next 1x3 block, and q and p still work meanwhile; other keys are
+   thrown away. Once every key has been handled and no more are
+   coming, the player has gone, so that counts as quitting, unless
+   the game is playing itself. */
+static int handlekeys(game_t *g, long long until)
+{
+	keyevent_t *e;
+
+	if (interrupted)
+		return 1;
+	while ((e = keyat(0)) != NULL && e->when <= until)
+	{
+		long long seen = e->when;
+		int ch = e->key;
+		int in = keyinput(ch);
+		int moved = 0;
+
+		if (in >= 0 && !playback && g->state != STATE_FALL)
+		{
+			int q;
+
+			e->held = 1;
+			if ((q = quitorpause(g, until)) > 0)
+				return 1;
+			if (q == 0)
+				break;
+			continue;
+		}
+
+		/* a key kept over a cascade counts from when it could act */
+		if (e->held)
+			seen = monotime();
+		takekeys(1);
+
+		if (ch == 'q') /* quit the game */
+			return 1;
+		else if (ch == 'p')
+		{
+			pausegame(g);
+			if (interrupted)
+				return 1;
+		}
+		else if (in >= 0 && !playback)
+			moved = playinput(g, (gameinput_t)in);
+
+		if (moved)
+		{
+			if (instrument)
+				framekey(seen);
+			drawframe(g);
+		}
+	}
+
+	if (inputgone() && keyat(0) == NULL && !playback && botdepth == 0)
+	{
+		endmsg = "No more keys to read";
+		return 1;
+	}
+	return 0; /* nope, the player doesn't want to quit just yet */
+}
+
+/* wait for it to be time for the next tick, handling keys and window
+   size changes meanwhile; return 1 if the player wants to quit */
+static int waitfortick(game_t *g)
+{
+	struct pollfd fds[3];
+
+	if (handlekeys(g, sched.due))
+		return 1;
+	if (schedbehind(&sched))
+		return 0; /* catching up; no waiting */
+
+	settimer(sched.due);
+
+	fds[0].fd = inputfd();
+	fds[1].fd = sigpipe[0];
+	fds[2].fd = tickfd;
+	fds[0].events = fds[1].events = fds[2].events = POLLIN;
+
+	for (;;)
+	{
+		if (poll(fds, 3, -1) < 0 && !interrupted)
+			continue; /* SIGWINCH; the pipe has it */
+		if (interrupted)
+			return 1;
+
+		if (fds[0].revents & POLLIN)
+		{
+			clearinput();
+			if (handlekeys(g, sched.due))
+				return 1;
+		}
+		if (fds[1].revents & POLLIN)
+			resize(g);
+		if (fds[2].revents & POLLIN)
+		{
+			uint64_t expirations;
+			(void)read(tickfd, &expirations, sizeof expirations);
+			return handlekeys(g, sched.due);
+		}
+	}
+}
+
+/* say how well the game kept to its schedule */
+static void timingreport(void)
+{
+	static char report[200];
+	long n = sched.ticks > 0 ? sched.ticks : 1;
+
+	(void)snprintf(report, sizeof report,
+		"%ld ticks, late by %.2f ms on average and %.2f ms at worst, "
+		"%ld caught up, %ld restarts",
+		sched.ticks, (double)sched.lateness / n / 1e6,
+		(double)sched.worst / 1e6, sched.caughtup, sched.resyncs);
+	endmsg = report;
+}
+
+/* add what -i measured to the message shown at the end */
+static void statsummary(void)
+{
+	static char report[1024];
+	size_t len = 0;
+
+	if (endmsg != NULL)
+		len = (size_t)snprintf(report, sizeof report, "%s\n", endmsg);
+	statsreport(report + len, sizeof report - len);
+	endmsg = report;
+}
+
+static void playgame(int w, int h, unsigned long seed)
+{
+	game_t *game;
+
+	if ((game = startgame(w, h, seed)) == NULL)
+		die("Not enough memory for the playfield");
+	game->threads = numprocessors();
+	botrng = (uint64_t)seed * 2 + 1; /* never 0 */
+	setupevents();
+
+	redrawscreen(game);
+	startrender(instrument);
+	if (!startinput())
+		die("Can't start reading keys");
+
+	schedstart(&sched, tickdelay(game));
+
+	while (game->state != STATE_GAMEOVER)
+	{
+		if (playback)
+		{
+			if (playreplay(game))
+				break;
+			drawframe(game); /* show the replayed moves */
+		}
+		else if (botdepth > 0)
+			botmove(game);
+
+		if (fastplay ? handlekeys(game, LLONG_MAX)
+			: waitfortick(game))
+		{
+			break;
+		}
+
+		schedtick(&sched);
+		simframe(game);
+		schednext(&sched, tickdelay(game));
+
+		/* if the next tick is due already, skip drawing this one */
+		if (fastplay || !schedbehind(&sched))
+			drawframe(game);
+	}
+
+	recordend(game->ticks);
+	playend();
+	drawscreen(game);
+	stoprender();
+	stopinput();
+
+	if (showtiming)
+		timingreport();
+	if (instrument)
+		statsummary();
+
+	if (!fastplay)
+		millisleep(1000);
+	endgame(game);
+}
+
+/* is w by h a playfield size the game allows? */
+static int sizeok(int w, int h)
+{
+	return w >= MIN_WIDTH && w <= BIG_MAX
+		&& h >= MIN_HEIGHT && h <= BIG_MAX;
+}
+
 int main(int argc, char *argv[])
 {
 	extern char *optarg;
 	extern int optind;
 	int width = DEF_WIDTH;
 	int height = DEF_HEIGHT;
+	unsigned long seed = (unsigned long)time(NULL);
+	char *recordto = NULL;
+	char *playfrom = NULL;
+	int useansi = 0;
 	int ch;
 	int warned = 0;
 
-	while ((ch = getopt(argc, argv, "h:w:")) != -1)
+	while ((ch = getopt(argc, argv, "ab:fh:ip:r:s:tw:")) != -1)
 	{
 		switch (ch)
 		{
+		case 'a':
+			useansi = 1;
+			break;
+		case 'b':
+			botdepth = atoi(optarg);
+			if (botdepth < 1)
+				botdepth = 1;
+			break;
+		case 'f':
+			fastplay = 1;
+			break;
+		case 'i':
+			instrument = 1;
+			break;
+		case 'p':
+			playfrom = optarg;
+			break;
+		case 'r':
+			recordto = optarg;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			showtiming = 1;
+			break;
 		case 'h':
 			height = atoi(optarg);
 			if (height < MIN_HEIGHT)
@@ -58,12 +480,12 @@ int main(int argc, char *argv[])
 				warned = 1;
 				height = MIN_HEIGHT;
 			}
-			else if (height > MAX_HEIGHT)
+			else if (height > BIG_MAX)
 			{
 				(void)printf("Height value too big, "
-					"using %d\n", MAX_HEIGHT);
+					"using %d\n", BIG_MAX);
 				warned = 1;
-				height = MAX_HEIGHT;
+				height = BIG_MAX;
 			}
 			break;
 		case 'w':
@@ -75,12 +497,12 @@ int main(int argc, char *argv[])
 				warned = 1;
 				width = MIN_WIDTH;
 			}
-			else if (width > MAX_WIDTH)
+			else if (width > BIG_MAX)
 			{
 				(void)printf("Width value too big, "
-					"using %d\n", MAX_WIDTH);
+					"using %d\n", BIG_MAX);
 				warned = 1;
-				width = MAX_WIDTH;
+				width = BIG_MAX;
 			}
 			break;
 		case '?':
@@ -91,29 +513,47 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (playfrom != NULL)
+	{
+		if (!loadreplay(playfrom, &seed, &width, &height)
+			|| !sizeok(width, height))
+		{
+			(void)printf("Can't play back %s\n", playfrom);
+			exit(1);
+		}
+		playback = 1;
+	}
+	else if (recordto != NULL
+		&& !recordreplay(recordto, seed, width, height))
+	{
+		(void)printf("Can't record to %s\n", recordto);
+		exit(1);
+	}
+
+	if (botdepth > 0 && (width > MAX_WIDTH || height > MAX_HEIGHT))
+	{
+		(void)printf("The computer only plays playfields up to %d "
+			"by %d\n", MAX_WIDTH, MAX_HEIGHT);
+		exit(1);
+	}
+
 	if (warned)
 		millisleep(1000);
 
-	(void)signal(SIGINT, finish);
+	(void)signal(SIGINT, interrupt);
 
-	(void)initscr();
-	(void)keypad(stdscr, TRUE);
-	(void)nonl();
-	(void)noecho();
-	(void)cbreak();
-	(void)nodelay(stdscr, TRUE);
-	(void)curs_set(0); /* invisible cursor */
+	startscreen(useansi);
 
-	/* make sure the chosen width and height aren't too big */
+	/* make sure there's room for at least some of the playfield */
 	if (!playsizeok(width, height))
 		die("Screen is too small to accommodate the playfield");
 
 	(void)argc;
 	(void)argv;
 
-	playgame(width, height);
+	playgame(width, height, seed);
 
-	finish(0);
+	finish();
 
 	/* NOTREACHED */
 	return 0;
@@ -12,117 +12,101 @@ columns.h: definitions
 #include <signal.h>
 #include <ctype.h>
 #include <time.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
 
-#define MAX_WIDTH   50
-#define DEF_WIDTH   10
-#define MIN_WIDTH    8
-
-#define MAX_HEIGHT  30
-#define DEF_HEIGHT  15
-#define MIN_HEIGHT  10
+#include "game.h"
+#include "pool.h"
+#include "trace.h"
 
 #define PANEL_WIDTH 12
 
-#define CH_BLOCKS "%@#$&O"              /* blocks; first one is special */
-#define NUMBLOCKS (strlen(CH_BLOCKS)-1) /* % doesn't count */
-
-/*
-A Columns game in progress can be in one of three states at a particular 
-time:
-
-1. Controlled falling:
-
-	A 1x3 block is falling. The player can move it to the left, move 
-it to the right, shift the 1x1 blocks comprising it, or speed its 
-descent.
-
-	The blocks move down a row every d milliseconds, where d is some 
-number (which gets smaller as the game progresses). When it is time for 
-the blocks to move again but they can move no further due to blocks 
-below them, either one of the blocks is above the visible top of the 
-playing field and the game ends, or there are some blocks to destroy and 
-the game goes to state 2, or there are no blocks to destroy and the game 
-returns to this state with a new 1x3 block.
-
-2. Blinking:
-
-	Some blocks are to be destroyed. They are blinking; every b 
-milliseconds they disappear or reappear. The blinking occurs t times. b 
-and t are some constants.
-
-	After the blinking is done, the blocks to be destroyed are 
-destroyed and the state goes to 3.
-
-3. Uncontrolled falling:
-
-	Any blocks that are now above space fall. They fall at a rate of 
-one row every d' milliseconds. I think d' is a constant that is less 
-than the initial value of d, but it might be the same as d itself.
-
-	When it is time for blocks to fall but none have space to fall 
-into, either more blocks need destroying and the state goes to 2, or no 
-blocks are left to be destroyed and the state goes to 1.
+/* what stats.c measures */
+#define STAT_SIM   0
+#define STAT_DRAW  1
+#define STAT_BYTES 2
+#define STAT_LAG   3
+#define STAT_WAIT  4
 
-So: we need constants b and t, and a variable d, and a constant d'.
-*/
-
-#define BLINK_DELAY          33
-#define BLINK_TIMES           8
-
-#define DELAY_DECREASE       31
-
-/* initial: starting fall delay for a normal fall
-   gravity: delay for a fall induced by gravity (non-interactive)
-   accel:   delay for when the player is holding the down arrow key */
-#define FALL_DELAY_INITIAL (355 + DELAY_DECREASE)
-#define FALL_DELAY_GRAVITY   50
-#define FALL_DELAY_ACCEL     50
-
-/* destroyer blocks are the %%% blocks that occasionally come down and
-   destroy all blocks of the color they land on
-   window:   how many values for "number of blocks to next level" during
-             which a destroyer block is possible
-   minlevel: never drop a destroyer block on a lower level than this
-   mincount: minimum number of blocks in playing field to drop a
-             destroyer block
-   chance:   the chance of dropping a destroyer block when the above
-             conditions are met is 1 in this many */
-#define DESTROYER_BLOCK_WINDOW    8
-#define DESTROYER_BLOCK_MINLEVEL  2
-#define DESTROYER_BLOCK_MINCOUNT 16
-#define DESTROYER_BLOCK_CHANCE    3
-
-/* when the "destroyer block window" starts and ends */
-#define DESTROYER_BLOCK_WINSTART 22
-#define DESTROYER_BLOCK_WINEND \
-	(DESTROYER_BLOCK_WINSTART + DESTROYER_BLOCK_WINDOW)
-
-/*
-	When you destroy numblocks blocks at a time, you get (numblocks *
-(level + scorebonus)) points, where level is your level number (1 to 10), 
-and scorebonus is 0 for blocks destroyed by a direct match. This formula 
-is not from the original Columns but seems to work fairly well.
-
-	Every time there is a chain reaction (e.g. gravity causes more 
-blocks to match and be eliminated), scorebonus is incremented by one, 
-until it reaches the following, its maximum value.
-*/
-#define SCOREBONUS_MAX            4
-
-typedef enum
+typedef struct
+{
+	long long due;      /* when the next tick should run (monotime()) */
+	long ticks;
+	long long lateness; /* ns the ticks ran late, in all */
+	long long worst;    /* ns the latest tick was late */
+	long caughtup;      /* ticks that were due before the last one ran */
+	long resyncs;       /* times the schedule started over */
+} sched_t;
+
+/* a key, and when it was pressed (monotime()) */
+typedef struct
 {
-	STATE_FALL,
-	STATE_BLINK,
-	STATE_GRAVITY,
-	STATE_GAMEOVER
-} gamestate_t;
+	int key;
+	long long when;
+	int held;       /* kept until the next block started falling */
+} keyevent_t;
 
 void millisleep(int ms);
-void playgame(int w, int h);
 
+long long monotime(void);
+void schedstart(sched_t *s, int ms);
+void schedtick(sched_t *s);
+void schednext(sched_t *s, int ms);
+int schedbehind(const sched_t *s);
+void schedresume(sched_t *s, int ms);
+
+void startscreen(int useansi);
+void benchscreen(int ofd);
+void endscreen(void);
+void resizescreen(int rows, int cols);
+int readkey(void);
+int readkeywait(void);
 int playsizeok(int width, int height);
 void drawborders(int width, int height);
 void drawblock(int row, int col, chtype ch);
 void drawlevel(int level);
 void drawscore(int score);
+void drawscreen(game_t *g);
+void redrawscreen(game_t *g);
+void startrender(int measure);
+void stoprender(void);
+void framekey(long long seen);
 void updatescreen(void);
+long long screenbytes(void);
+void drawpanelline(int line, const char *s);
+
+void statadd(int which, long long v);
+void drawstats(void);
+void statsreport(char *buf, size_t size);
+
+int ansistart(int ifd, int ofd);
+void ansiend(void);
+void ansiresize(int r, int c);
+int ansirows(void);
+int ansicols(void);
+long long ansibytes(void);
+void ansiput(int row, int col, char ch);
+void ansiclear(void);
+void ansiflush(void);
+void ansikeys(int ifd);
+int ansikey(void);
+int ansikeywait(void);
+
+int startinput(void);
+void stopinput(void);
+int inputfd(void);
+void clearinput(void);
+int inputgone(void);
+keyevent_t *keyat(int i);
+void takekeys(int n);
+
+int recordreplay(const char *file, unsigned long seed, int w, int h);
+void recordinput(long tick, gameinput_t in);
+void recordend(long tick);
+int loadreplay(const char *file, unsigned long *seed, int *w, int *h);
+int playreplay(game_t *g);
+void playend(void);
@@ -4,36 +4,13 @@ This file is public domain; anyone may deal in it without restriction.
 game.c: playing the game
 */
 
-#include "columns.h"
+#include "game.h"
+#include "trace.h"
 
-static gamestate_t state;
+/* find matches with bit planes rather than cell by cell */
+#define BITBOARD
 
-static int width;
-static int height;
-
-static char playfield [MAX_HEIGHT+3][MAX_WIDTH];
-static char blinking  [MAX_HEIGHT+3][MAX_WIDTH];
-static char cleanblock[MAX_HEIGHT+3][MAX_WIDTH];
-
-static int fallcol     = 0;  /* column of the 1x3 falling blocks */
-static int fallrow     = 0; /* top row of the 1x3 falling blocks */
-
-static char fallspecial = ' '; /* what the %%% block fell on */
-
-static int falldelay;
-
-static int blinkcount;
-
-static int level;
-static int score;
-static int nextlevel;
-static int blockcount;
-
-static int destlevel; /* last level on which a destroyer block fell */
-
-static int scorebonus;
-
-static const char *blocks = CH_BLOCKS;
+static const char blocks[] = CH_BLOCKS;
 
 static int tolevel[] =
 {
@@ -50,256 +27,475 @@ static int tolevel[] =
 	INT_MAX /* let's hope this doesn't happen */
 };
 
-static long progstarttime;
+/* which plane a block belongs in, or -1 for no block; setblock() is
+   called often enough for a loop the compiler can unroll to be worth
+   having instead of strchr() */
+static int blocktype(char ch)
+{
+	int t;
+
+	if (ch == ' ')
+		return -1;
+	for (t = 0; t < BLOCKTYPES; t++)
+	{
+		if (blocks[t] == ch)
+			return t;
+	}
+	return -1;
+}
+
+/*
+	How cells are stored. Each cell is a byte in the game's store (see
+game.h), in rows only as long as the playfield is wide, so a whole
+playfield of the default size fits in three cache lines. Normally the
+byte is the character the block is drawn with; with PACKEDCELLS it's
+the block's type instead, which saves looking the type up every time
+a block moves. Whether a cell is blinking and whether it has been drawn
+are kept apart from its block, as one bit per cell in rows like the
+planes, so the few cells blinking or waiting to be drawn can be found
+without looking at the rest. A big playfield's cells are always packed,
+in the tiles big.c keeps them in, and big.c looks after them, flags and
+all; here they're only read.
+*/
+#define BIGCELL(g, r, c) (*bigcell((g)->big, (r), (c)))
+
+#ifdef PACKEDCELLS
 
-static void starttimer(void)
+#define CELL(g, r, c) (*((g)->big != NULL ? bigcell((g)->big, (r), (c)) \
+	: &CELLS(g)[(r) * (g)->width + (c)]))
+
+/* the type of block at row, col, or -1 for none */
+static int typeat(const game_t *g, int row, int col)
 {
-	struct timeval progstart;
-	(void)gettimeofday(&progstart, NULL);
-	progstarttime = progstart.tv_sec * 1000
-		+ progstart.tv_usec / 1000;
+	return (CELL(g, row, col) & CELL_TYPE) - 1;
 }
 
-static long gettime(void)
+/* what's in a cell, by its CELL_TYPE bits */
+static const char cellblocks[] = " " CH_BLOCKS;
+
+static char cellblock(const game_t *g, int row, int col)
 {
-	struct timeval tv;
-	long thetime;
-	(void)gettimeofday(&tv, NULL);
-	thetime = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-	return thetime - progstarttime;
+	return cellblocks[CELL(g, row, col) & CELL_TYPE];
 }
 
-/* delay(n)  to start a delay of n milliseconds
-   delay(0)  to actually wait until the delay is over
-   delay(-1) to check how many ms of the delay are left */
-static int delay(int ms)
+/* put content, of type t, at row, col, to be drawn; not for big
+   playfields, where bigput() does it */
+static void putcell(game_t *g, int row, int col, char content, int t)
 {
-	static long endtime;
+	(void)content;
+	CELLS(g)[row * g->width + col] = (unsigned char)(t + 1);
+	DIRTYBITS(g)[row] |= (uint64_t)1 << col;
+}
 
-	if (ms > 0)       /* set delay */
-	{
-		endtime = gettime() + ms;
-		return ms;
-	}
-	else if (ms == 0) /* actually wait */
-	{
-		long timeleft = endtime - gettime();
-		while (timeleft > 0)
-		{
-			millisleep((int)timeleft);
-			timeleft = endtime - gettime();
-		}
-		return 0;
-	}
-	else              /* how many ms left? */
-	{
-		long timeleft = endtime - gettime();
-		if (timeleft < 0)
-			return 0;
-		return (int)timeleft;
-	}
+#else
+
+static const char cellblocks[] = " " CH_BLOCKS;
+
+static int typeat(const game_t *g, int row, int col)
+{
+	if (g->big != NULL)
+		return (BIGCELL(g, row, col) & CELL_TYPE) - 1;
+	return blocktype((char)CELLS(g)[row * g->width + col]);
 }
 
-static void setblock(int row, int col, char content)
+static char cellblock(const game_t *g, int row, int col)
 {
-	playfield [row][col] = content;
-	cleanblock[row][col] = 0;
+	if (g->big != NULL)
+		return cellblocks[BIGCELL(g, row, col) & CELL_TYPE];
+	return (char)CELLS(g)[row * g->width + col];
 }
 
-static char getblock(int row, int col)
+static void putcell(game_t *g, int row, int col, char content, int t)
 {
-	if (row < 0 || row >= height || col < 0 || col >= width)
-		return ' ';
-	return playfield[row][col];
+	(void)t;
+	CELLS(g)[row * g->width + col] = (unsigned char)content;
+	DIRTYBITS(g)[row] |= (uint64_t)1 << col;
 }
 
-/* draw all the blocks */
-static void drawscreen(void)
+#endif
+
+static int blinkingat(const game_t *g, int row, int col)
 {
-	static int lastlevel = -2;
-	static int lastscore = -2;
-	int r, c;
+	if (g->big != NULL)
+		return bigblinking(g->big, row, col);
+	return (int)(BLINKBITS(g)[row] >> col) & 1;
+}
+
+static void putblinking(game_t *g, int row, int col, int on)
+{
+	if (g->big != NULL)
+		bigblink(g->big, row, col, on);
+	else if (on)
+		BLINKBITS(g)[row] |= (uint64_t)1 << col;
+	else
+		BLINKBITS(g)[row] &= ~((uint64_t)1 << col);
+}
+
+static int cleanat(const game_t *g, int row, int col)
+{
+	if (g->big != NULL)
+		return bigclean(g->big, row, col);
+	return !((DIRTYBITS(g)[row] >> col) & 1);
+}
+
+static void putclean(game_t *g, int row, int col, int on)
+{
+	if (g->big != NULL)
+		bigsetclean(g->big, row, col, on);
+	else if (on)
+		DIRTYBITS(g)[row] &= ~((uint64_t)1 << col);
+	else
+		DIRTYBITS(g)[row] |= (uint64_t)1 << col;
+}
+
+/*
+	Every block of every type in every cell has a random 64-bit key,
+and g->hash is all the keys of the blocks in the playfield XORed
+together, so two playfields with the same blocks have the same hash and
+putting a block in or taking it out is one XOR. The keys are made up
+from the cell and type as they're needed, which saves a table shared
+by every game and every thread. Only playfields up to MAX_WIDTH wide
+have a hash: nothing searches bigger ones, and their cells would share
+keys.
+*/
+static uint64_t zobrist(int row, int col, int t)
+{
+	uint64_t z = ((uint64_t)row * MAX_WIDTH + (uint64_t)col)
+		* BLOCKTYPES + (uint64_t)t;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
 
-	for (r = 3; r < height; r++)
-	for (c = 0; c < width;  c++)
+/* what kind of change a change_t is */
+#define UNDO_BLOCK   0 /* setblock() */
+#define UNDO_BLINK   1 /* setblinking() */
+#define UNDO_CHANGED 2 /* CHANGED(g)[row] being cleared */
+#define UNDO_DROP    3 /* DROPS(g)[word], saved by savegame() */
+#define UNDO_LEVEL   4 /* g->level and g->falldelay going up a level */
+#define UNDO_DESTLEV 5 /* g->destlevel */
+
+/* add a change to the ones g is keeping */
+static void keep(game_t *g, int kind, int row, int col, char old,
+	uint64_t word)
+{
+	undo_t *u = g->undo;
+	change_t *c;
+
+	if (u->count == u->size)
 	{
-		if (!cleanblock[r][c])
+		size_t newsize = u->size * 2 + 256;
+		change_t *bigger = realloc(u->changes, newsize * sizeof *bigger);
+
+		if (bigger == NULL)
 		{
-			drawblock(r-3, c, (chtype)getblock(r, c));
-			cleanblock[r][c] = 1;
+			u->lost = 1;
+			return;
 		}
+		u->changes = bigger;
+		u->size = newsize;
 	}
 
-	if (score != lastscore)
+	c = &u->changes[u->count++];
+	c->word = word;
+	c->kind = (unsigned char)kind;
+	c->row  = (unsigned char)row;
+	c->col  = (unsigned char)col;
+	c->old  = old;
+}
+
+void setblock(game_t *g, int row, int col, char content)
+{
+	int old = typeat(g, row, col);
+	int t = blocktype(content);
+
+	if (g->undo != NULL && g->undo->stamp[row][col] != g->undo->epoch)
+	{
+		g->undo->stamp[row][col] = g->undo->epoch;
+		keep(g, UNDO_BLOCK, row, col, cellblock(g, row, col),
+			CHANGED(g)[row]);
+	}
+
+	if (g->big != NULL)
+		bigput(g->big, row, col, old, t);
+	else
 	{
-		lastscore = score;
-		drawscore(score);
-		if (level != lastlevel)
+		uint64_t bit = (uint64_t)1 << col;
+		uint64_t *planes = PLANES(g, 0) + row;
+		uint64_t *changed = CHANGED(g) + row;
+
+		if (old >= 0)
+			planes[old * g->height] &= ~bit;
+		if (t >= 0)
 		{
-			lastlevel = level;
-			drawlevel(level);
+			planes[t * g->height] |= bit;
+			*changed |= bit;
 		}
+		else /* a space can't be part of a match */
+			*changed &= ~bit;
+		COLBLOCKS(g)[col] += (t >= 0) - (old >= 0);
+		putcell(g, row, col, content, t);
+		if (old >= 0)
+			g->hash ^= zobrist(row, col, old);
+		if (t >= 0)
+			g->hash ^= zobrist(row, col, t);
 	}
-	updatescreen();
+	if (old >= 0)
+		g->typecount[old]--;
+	if (t >= 0)
+		g->typecount[t]++;
+}
+
+/* setblock() for restoregame(): no change kept, no hash (the snapshot
+   has it) and no changed bit (the change kept has the whole row) */
+static void putback(game_t *g, int row, int col, char content)
+{
+	int old = typeat(g, row, col);
+	int t = blocktype(content);
+
+	if (old >= 0)
+	{
+		PLANES(g, old)[row] &= ~((uint64_t)1 << col);
+		g->typecount[old]--;
+	}
+	if (t >= 0)
+	{
+		PLANES(g, t)[row] |= (uint64_t)1 << col;
+		g->typecount[t]++;
+	}
+	COLBLOCKS(g)[col] += (t >= 0) - (old >= 0);
+	putcell(g, row, col, content, t);
+}
+
+static void setblinking(game_t *g, int row, int col, int on)
+{
+	if (g->undo != NULL)
+		keep(g, UNDO_BLINK, row, col, (char)blinkingat(g, row, col), 0);
+	putblinking(g, row, col, on);
+}
+
+static char getblock(const game_t *g, int row, int col)
+{
+	if (row < 0 || row >= g->height || col < 0 || col >= g->width)
+		return ' ';
+	return cellblock(g, row, col);
+}
+
+/* the game has its own random number generator (xorshift64*), so that
+   the same seed always gives the same game */
+static unsigned long nextrandom(game_t *g)
+{
+	g->rng ^= g->rng >> 12;
+	g->rng ^= g->rng << 25;
+	g->rng ^= g->rng >> 27;
+	return (unsigned long)((g->rng * 2685821657736338717ULL) >> 33);
 }
 
-static void startfall(void)
+static void seedrandom(game_t *g, unsigned long seed)
 {
-	fallrow = 0;
-	fallcol = width / 2;
-	if (destlevel < level /* no destroyer blocks yet for this level */
-		&& nextlevel >= DESTROYER_BLOCK_WINSTART
-		&& nextlevel < DESTROYER_BLOCK_WINEND
-		&& level >= DESTROYER_BLOCK_MINLEVEL
-		&& blockcount > DESTROYER_BLOCK_MINCOUNT
-		&& random()%DESTROYER_BLOCK_CHANCE == 0)
+	/* scramble the seed (splitmix64) so nearby seeds give unrelated
+	   games; the state must not be zero */
+	uint64_t z = (uint64_t)seed + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	g->rng = z != 0 ? z : 1;
+}
+
+static void startfall(game_t *g)
+{
+	g->fallrow = 0;
+	g->fallcol = g->width / 2;
+	if (g->destlevel < g->level /* no destroyer blocks yet for this level */
+		&& g->nextlevel >= DESTROYER_BLOCK_WINSTART
+		&& g->nextlevel < DESTROYER_BLOCK_WINEND
+		&& g->level >= DESTROYER_BLOCK_MINLEVEL
+		&& countblocks(g) > DESTROYER_BLOCK_MINCOUNT
+		&& nextrandom(g)%DESTROYER_BLOCK_CHANCE == 0)
 	{
 		/* make it a %%% block */
-		setblock(fallrow,   fallcol, blocks[0]);
-		setblock(fallrow+1, fallcol, blocks[0]);
-		setblock(fallrow+2, fallcol, blocks[0]);
+		setblock(g, g->fallrow,   g->fallcol, blocks[0]);
+		setblock(g, g->fallrow+1, g->fallcol, blocks[0]);
+		setblock(g, g->fallrow+2, g->fallcol, blocks[0]);
 
 		/* make sure not to send another one on the same level */
-		destlevel = level;
+		if (g->undo != NULL)
+			keep(g, UNDO_DESTLEV, 0, 0, 0,
+				(uint64_t)(uint32_t)g->destlevel);
+		g->destlevel = g->level;
 	}
 	else
 	{
-		setblock(fallrow,   fallcol, blocks[1 + random()%NUMBLOCKS]);
-		setblock(fallrow+1, fallcol, blocks[1 + random()%NUMBLOCKS]);
-		setblock(fallrow+2, fallcol, blocks[1 + random()%NUMBLOCKS]);
+		setblock(g, g->fallrow,   g->fallcol,
+			blocks[1 + nextrandom(g)%NUMBLOCKS]);
+		setblock(g, g->fallrow+1, g->fallcol,
+			blocks[1 + nextrandom(g)%NUMBLOCKS]);
+		setblock(g, g->fallrow+2, g->fallcol,
+			blocks[1 + nextrandom(g)%NUMBLOCKS]);
 	}
-	state = STATE_FALL;
+	g->state = STATE_FALL;
+
+	g->pieces++;
+}
+
+/* the top row of the blocks resting in col, or g->height if there
+   are none; only while blocks are falling, when the rest have no
+   spaces under them */
+static int stacktop(const game_t *g, int col)
+{
+	int n = g->big != NULL ? bigcolumn(g->big, col) : COLBLOCKS(g)[col];
 
-	blockcount += 3;
+	if (col == g->fallcol)
+		n -= 3;
+	return g->height - n;
 }
 
-/* test if a block can fall */
-static int canfall(int row, int col)
+/* how tall the stack of blocks in col is, not counting falling ones */
+int stackheight(const game_t *g, int col)
 {
-	return row + 1 < height && getblock(row + 1, col) == ' '
-		&& getblock(row, col) != ' ';
+	return g->height - stacktop(g, col);
 }
 
 /* blocks were destroyed; lower the next level countdown accordingly
    and increase score */
-static void blocksdestroyed(int num)
+static void blocksdestroyed(game_t *g, int num)
 {
-	score      += num * (scorebonus + level);
-	nextlevel  -= num;
-	blockcount -= num;
-	if (nextlevel < 0)
+	g->score      += num * (g->scorebonus + g->level);
+	g->nextlevel  -= num;
+	if (g->nextlevel < 0)
 	{
 		/* advance a level */
-		level++;
-		falldelay -= DELAY_DECREASE;
-
-		nextlevel = tolevel[level];
+		if (g->undo != NULL)
+			keep(g, UNDO_LEVEL, 0, 0, 0,
+				(uint64_t)(uint32_t)g->level << 32
+				| (uint32_t)g->falldelay);
+		g->level++;
+		g->falldelay -= DELAY_DECREASE;
+
+		g->nextlevel = tolevel[g->level];
 	}
 }
 
 /* move a block */
-static void moveblock(int orow, int ocol, int nrow, int ncol)
+static void moveblock(game_t *g, int orow, int ocol, int nrow, int ncol)
 {
-	setblock(nrow, ncol, getblock(orow, ocol));
-	setblock(orow, ocol, ' ');
+	setblock(g, nrow, ncol, getblock(g, orow, ocol));
+	setblock(g, orow, ocol, ' ');
 }
 
 /* lower a block by one row */
-static void lower(int row, int col)
+static void lower(game_t *g, int row, int col)
 {
-	moveblock(row, col, row + 1, col);
+	moveblock(g, row, col, row + 1, col);
 }
 
 /* move the falling blocks left or right */
-static int movefallingblocks(int colchange)
+static int movefallingblocks(game_t *g, int colchange)
 {
-	int newcol = fallcol + colchange;
+	int newcol = g->fallcol + colchange;
+	int row = g->fallrow;
 
-	if (newcol < 0 || newcol >= width
-		|| getblock(fallrow    , newcol) != ' '
-		|| getblock(fallrow + 1, newcol) != ' '
-		|| getblock(fallrow + 2, newcol) != ' ')
+	if (newcol < 0 || newcol >= g->width
+		|| row + 2 >= stacktop(g, newcol))
 	{
 		return 0;
 	}
 
-	moveblock(fallrow    , fallcol, fallrow    , newcol);
-	moveblock(fallrow + 1, fallcol, fallrow + 1, newcol);
-	moveblock(fallrow + 2, fallcol, fallrow + 2, newcol);
+	moveblock(g, row    , g->fallcol, row    , newcol);
+	moveblock(g, row + 1, g->fallcol, row + 1, newcol);
+	moveblock(g, row + 2, g->fallcol, row + 2, newcol);
 
-	fallcol = newcol;
+	g->fallcol = newcol;
 	return 1;
 }
 
 /* shuffle the falling blocks' order */
-static void shuffleblocks(void)
+static void shuffleblocks(game_t *g)
 {
+	int row = g->fallrow;
+	int col = g->fallcol;
 	char tmp;
 
 	/* shift each one down */
-	tmp = getblock(fallrow + 2, fallcol);
-	setblock(fallrow + 2, fallcol, getblock(fallrow + 1, fallcol));
-	setblock(fallrow + 1, fallcol, getblock(fallrow    , fallcol));
-	setblock(fallrow    , fallcol, tmp);
+	tmp = getblock(g, row + 2, col);
+	setblock(g, row + 2, col, getblock(g, row + 1, col));
+	setblock(g, row + 1, col, getblock(g, row    , col));
+	setblock(g, row    , col, tmp);
 }
 
 /* make the 1x3 block fall down a row; return 1 if successful */
-static int makeblocksfall(void)
+static int makeblocksfall(game_t *g)
 {
-	if (!canfall(fallrow + 2, fallcol))
+	int row = g->fallrow;
+	int col = g->fallcol;
+
+	if (row + 3 >= stacktop(g, col))
 	{
 		/* if it's a %%% block falling, set fallspecial, so
 		   we can destroy all blocks of the color it landed on */
-		if (getblock(fallrow + 2, fallcol) == blocks[0]
-			&& fallrow + 3 < height)
+		if (getblock(g, row + 2, col) == blocks[0]
+			&& row + 3 < g->height)
 		{
-			fallspecial = getblock(fallrow + 3, fallcol);
+			g->fallspecial = getblock(g, row + 3, col);
 		}
 
 		return 0;
 	}
 
-	lower(fallrow + 2, fallcol);
-	lower(fallrow + 1, fallcol);
-	lower(fallrow,     fallcol);
+	lower(g, row + 2, col);
+	lower(g, row + 1, col);
+	lower(g, row,     col);
 
-	fallrow++;
+	g->fallrow++;
 
 	return 1;
 }
 
 /* destroy all blinking blocks */
-static void destroyblinkers(void)
+void destroyblinkers(game_t *g)
 {
 	int r, c;
 	int numdest = 0;
 
-	for (r = 3; r < height; r++)
-	for (c = 0; c < width;  c++)
+	TRACE_BEGIN("destroyblinkers");
+	if (g->big != NULL)
+		numdest = bigdestroy(g);
+	else
 	{
-		if (blinking[r][c])
+		for (r = HIDDEN_ROWS; r < g->height; r++)
 		{
-			blinking[r][c] = 0;
-			setblock(r, c, ' ');
-			numdest++;
+			uint64_t m = BLINKBITS(g)[r];
+
+			for (; m != 0; m &= m - 1)
+			{
+				c = __builtin_ctzll(m);
+				setblinking(g, r, c, 0);
+				setblock(g, r, c, ' ');
+				g->holecols |= (uint64_t)1 << c;
+				LOWHOLE(g)[c] = (unsigned char)r;
+				numdest++;
+			}
 		}
 	}
 
-	blocksdestroyed(numdest);
+	blocksdestroyed(g, numdest);
+	g->destroyed += numdest;
+	TRACE_END("destroyblinkers");
 }
 
-static int matches(int row, int col, char color)
+static int matches(const game_t *g, int row, int col, char color)
 {
-	return getblock(row, col) == color;
+	return getblock(g, row, col) == color;
 }
 
 /* find matches centered at row, col */
-static int findmatchesfrom(int row, int col)
+int findmatchesfrom(game_t *g, int row, int col)
 {
 	char color;
 	int numfound = 0;
 
-	color = getblock(row, col);
+	color = getblock(g, row, col);
 	if (color == ' ')
 		return 0;
 
@@ -307,15 +503,15 @@ static int findmatchesfrom(int row, int col)
 	if (
 		(
 			(
-				matches(row-1, col, color)
+				matches(g, row-1, col, color)
 				&& (
-					matches(row-2, col, color)
-					|| matches(row+1, col, color)
+					matches(g, row-2, col, color)
+					|| matches(g, row+1, col, color)
 				)
 			)
 			|| (
-				matches(row+1, col, color)
-				&& matches(row+2, col, color)
+				matches(g, row+1, col, color)
+				&& matches(g, row+2, col, color)
 			)
 		)
 	)
@@ -323,22 +519,22 @@ static int findmatchesfrom(int row, int col)
 		int j;
 		for (j = row - 1; j >= 0; j--)
 		{
-			if (!matches(j, col, color))
+			if (!matches(g, j, col, color))
 				break;
-			if (!blinking[j][col])
+			if (!blinkingat(g, j, col))
 			{
 				numfound++;
-				blinking[j][col] = 1;
+				setblinking(g, j, col, 1);
 			}
 		}
-		for (j = row; j < height; j++)
+		for (j = row; j < g->height; j++)
 		{
-			if (!matches(j, col, color))
+			if (!matches(g, j, col, color))
 				break;
-			if (!blinking[j][col])
+			if (!blinkingat(g, j, col))
 			{
 				numfound++;
-				blinking[j][col] = 1;
+				setblinking(g, j, col, 1);
 			}
 		}
 	}
@@ -347,15 +543,15 @@ static int findmatchesfrom(int row, int col)
 	if (
 		(
 			(
-				matches(row, col-1, color)
+				matches(g, row, col-1, color)
 				&& (
-					matches(row, col-2, color)
-					|| matches(row, col+1, color)
+					matches(g, row, col-2, color)
+					|| matches(g, row, col+1, color)
 				)
 			)
 			|| (
-				matches(row, col+1, color)
-				&& matches(row, col+2, color)
+				matches(g, row, col+1, color)
+				&& matches(g, row, col+2, color)
 			)
 		)
 	)
@@ -363,22 +559,22 @@ static int findmatchesfrom(int row, int col)
 		int j;
 		for (j = col - 1; j >= 0; j--)
 		{
-			if (!matches(row, j, color))
+			if (!matches(g, row, j, color))
 				break;
-			if (!blinking[row][j])
+			if (!blinkingat(g, row, j))
 			{
 				numfound++;
-				blinking[row][j] = 1;
+				setblinking(g, row, j, 1);
 			}
 		}
-		for (j = col; j < width; j++)
+		for (j = col; j < g->width; j++)
 		{
-			if (!matches(row, j, color))
+			if (!matches(g, row, j, color))
 				break;
-			if (!blinking[row][j])
+			if (!blinkingat(g, row, j))
 			{
 				numfound++;
-				blinking[row][j] = 1;
+				setblinking(g, row, j, 1);
 			}
 		}
 	}
@@ -387,15 +583,15 @@ static int findmatchesfrom(int row, int col)
 	if (
 		(
 			(
-				matches(row-1, col-1, color)
+				matches(g, row-1, col-1, color)
 				&& (
-					matches(row-2, col-2, color)
-					|| matches(row+1, col+1, color)
+					matches(g, row-2, col-2, color)
+					|| matches(g, row+1, col+1, color)
 				)
 			)
 			|| (
-				matches(row+1, col+1, color)
-				&& matches(row+2, col+2, color)
+				matches(g, row+1, col+1, color)
+				&& matches(g, row+2, col+2, color)
 			)
 		)
 	)
@@ -403,22 +599,22 @@ static int findmatchesfrom(int row, int col)
 		int j, k;
 		for (j = col - 1, k = row - 1; j >= 0 && k >= 0; j--, k--)
 		{
-			if (!matches(k, j, color))
+			if (!matches(g, k, j, color))
 				break;
-			if (!blinking[k][j])
+			if (!blinkingat(g, k, j))
 			{
 				numfound++;
-				blinking[k][j] = 1;
+				setblinking(g, k, j, 1);
 			}
 		}
-		for (j = col, k = row; j < width && k < height; j++, k++)
+		for (j = col, k = row; j < g->width && k < g->height; j++, k++)
 		{
-			if (!matches(k, j, color))
+			if (!matches(g, k, j, color))
 				break;
-			if (!blinking[k][j])
+			if (!blinkingat(g, k, j))
 			{
 				numfound++;
-				blinking[k][j] = 1;
+				setblinking(g, k, j, 1);
 			}
 		}
 	}
@@ -427,38 +623,38 @@ static int findmatchesfrom(int row, int col)
 	if (
 		(
 			(
-				matches(row-1, col+1, color)
+				matches(g, row-1, col+1, color)
 				&& (
-					matches(row-2, col+2, color)
-					|| matches(row+1, col-1, color)
+					matches(g, row-2, col+2, color)
+					|| matches(g, row+1, col-1, color)
 				)
 			)
 			|| (
-				matches(row+1, col-1, color)
-				&& matches(row+2, col-2, color)
+				matches(g, row+1, col-1, color)
+				&& matches(g, row+2, col-2, color)
 			)
 		)
 	)
 	{
 		int j, k;
-		for (j = col + 1, k = row - 1; j < width && k >= 0; j++, k--)
+		for (j = col + 1, k = row - 1; j < g->width && k >= 0; j++, k--)
 		{
-			if (!matches(k, j, color))
+			if (!matches(g, k, j, color))
 				break;
-			if (!blinking[k][j])
+			if (!blinkingat(g, k, j))
 			{
 				numfound++;
-				blinking[k][j] = 1;
+				setblinking(g, k, j, 1);
 			}
 		}
-		for (j = col, k = row; j >= 0 && k < height; j--, k++)
+		for (j = col, k = row; j >= 0 && k < g->height; j--, k++)
 		{
-			if (!matches(k, j, color))
+			if (!matches(g, k, j, color))
 				break;
-			if (!blinking[k][j])
+			if (!blinkingat(g, k, j))
 			{
 				numfound++;
-				blinking[k][j] = 1;
+				setblinking(g, k, j, 1);
 			}
 		}
 	}
@@ -468,262 +664,787 @@ static int findmatchesfrom(int row, int col)
 	return numfound;
 }
 
-/* find any blocks that will be eliminated, and set them as blinking,
+/* mark as blinking the blocks of the type the %%% block landed on,
    returning the number found */
-static int findmatches(void)
+static int findspecial(game_t *g)
 {
 	int numfound = 0;
-	int r, c;
+	int r, t;
+
+	if ((t = blocktype(g->fallspecial)) < 0)
+		return 0;
+	g->fallspecial = ' ';
+	if (g->big != NULL)
+		return bigspecial(g, t);
 
-	if (fallspecial != ' ')
+	/* from the bottom up, stopping once every one has been found */
+	for (r = g->height - 1; r >= HIDDEN_ROWS && numfound < g->typecount[t];
+		r--)
 	{
-		for (r = 3; r < height; r++)
-		for (c = 0; c < width;  c++)
+		uint64_t m = PLANES(g, t)[r];
+
+		while (m != 0)
+		{
+			int c = __builtin_ctzll(m);
+
+			m &= m - 1;
+			numfound++;
+			setblinking(g, r, c, 1);
+		}
+	}
+
+	return numfound;
+}
+
+#ifdef BITBOARD
+/* find all matches on the whole playfield with the bit planes */
+static int scanmatches(game_t *g)
+{
+	uint64_t marks[MAX_HEIGHT+HIDDEN_ROWS];
+	int numfound = 0;
+	int r, t;
+
+	(void)memset(marks, 0, sizeof marks);
+
+	for (t = 0; t < BLOCKTYPES; t++)
+		bbruns(PLANES(g, t), g->height, marks);
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+	{
+		uint64_t m = marks[r];
+
+		while (m != 0)
 		{
-			if (getblock(r, c) == fallspecial)
+			int c = __builtin_ctzll(m);
+
+			m &= m - 1;
+			if (!blinkingat(g, r, c))
 			{
 				numfound++;
-				blinking[r][c] = 1;
+				setblinking(g, r, c, 1);
 			}
 		}
-		fallspecial = ' ';
 	}
 
-	for (r = 3; r < height; r++)
-	for (c = 0; c < width;  c++)
-		numfound += findmatchesfrom(r, c);
+	return numfound;
+}
+#else
+/* find all matches on the whole playfield, cell by cell */
+static int scanmatches(game_t *g)
+{
+	int numfound = 0;
+	int r, c;
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+	for (c = 0; c < g->width; c++)
+		numfound += findmatchesfrom(g, r, c);
 
 	return numfound;
 }
+#endif
+
+/*
+	Every match there was at the last findmatches() got destroyed, so
+any match now has to include a block that has been put somewhere since
+then. Those are the bits set in CHANGED(g), which setblock() clears
+again when a block moves on, so usually there are only a few of them
+(three, after a 1x3 block lands), and only the lines
+through them need checking. After a big cascade it's cheaper to just
+look at everything.
+*/
+#define RESCAN_THRESHOLD 16
+
+/* find any blocks that will be eliminated, and set them as blinking,
+   returning the number found */
+int findmatches(game_t *g)
+{
+	int numfound = 0;
+	int numchanged = 0;
+	int r;
+
+	TRACE_BEGIN("findmatches");
+	numfound += findspecial(g);
+	if (g->big != NULL)
+	{
+		numfound += bigmatches(g);
+		TRACE_END("findmatches");
+		return numfound;
+	}
+
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+		numchanged += __builtin_popcountll(CHANGED(g)[r]);
+
+	if (numchanged > RESCAN_THRESHOLD)
+		numfound += scanmatches(g);
+	else
+	{
+		for (r = HIDDEN_ROWS; r < g->height; r++)
+		{
+			uint64_t m = CHANGED(g)[r];
+
+			while (m != 0)
+			{
+				int c = __builtin_ctzll(m);
+
+				m &= m - 1;
+				numfound += findmatchesfrom(g, r, c);
+			}
+		}
+	}
+
+	if (g->undo != NULL)
+	{
+		for (r = 0; r < g->height; r++)
+		{
+			if (CHANGED(g)[r] != 0)
+				keep(g, UNDO_CHANGED, r, 0, 0, CHANGED(g)[r]);
+		}
+	}
+	(void)memset(CHANGED(g), 0, (size_t)g->height * sizeof (uint64_t));
+
+	TRACE_END("findmatches");
+	return numfound;
+}
 
 /* empty all the blocks */
-static void emptyblocks(void)
+static void emptyblocks(game_t *g)
 {
 	int r, c;
 
-	for (r = 0; r < height; r++)
-	for (c = 0; c < width;  c++)
-		setblock(r, c, ' ');
+	for (r = 0; r < g->height; r++)
+	for (c = 0; c < g->width; c++)
+		setblock(g, r, c, ' ');
 }
 
-/* replace all blinking blocks with spaces on the screen */
-static void hideblinkers(void)
+/* have the next findmatches() look at every cell */
+void changeall(game_t *g)
 {
-	int r, c;
+	int r;
 
-	for (r = 3; r < height; r++)
-	for (c = 0; c < width;  c++)
+	if (g->big != NULL)
 	{
-		if (blinking[r][c])
-			drawblock(r-3, c, ' ');
+		bigchangeall(g->big);
+		return;
 	}
+	for (r = 0; r < g->height; r++)
+		CHANGED(g)[r] = ((uint64_t)1 << g->width) - 1;
 }
 
-/* draw all blinking blocks onto the screen */
-static void showblinkers(void)
+/* mark all blinking blocks as needing to be redrawn */
+static void touchblinkers(game_t *g)
 {
-	int r, c;
+	int r;
 
-	for (r = 3; r < height; r++)
-	for (c = 0; c < width;  c++)
+	if (g->big != NULL)
 	{
-		if (blinking[r][c])
-			drawblock(r-3, c, (chtype)playfield[r][c]);
+		bigtouchblinkers(g->big);
+		return;
 	}
+	for (r = HIDDEN_ROWS; r < g->height; r++)
+		DIRTYBITS(g)[r] |= BLINKBITS(g)[r];
+}
+
+/* work out where every block in a column that had blocks destroyed
+   will end up, in one pass per column from the bottom up, and list
+   the moves in DROPS(g) without making them yet; the blocks below
+   the lowest one destroyed stay put, and counting the blocks above it
+   says when the last one has been passed */
+void compactcolumns(game_t *g)
+{
+	uint64_t cols = g->holecols;
+
+	TRACE_BEGIN("compactcolumns");
+	g->numdrops = 0;
+	g->dropstep = 0;
+	g->holecols = 0;
+	if (g->big != NULL)
+		bigcompact(g);
+
+	while (cols != 0)
+	{
+		int c = __builtin_ctzll(cols);
+		int to = LOWHOLE(g)[c];
+		int left = COLBLOCKS(g)[c] - (g->height - 1 - to);
+		int r;
+
+		cols &= cols - 1;
+
+		for (r = to - 1; r >= HIDDEN_ROWS && left > 0; r--)
+		{
+			drop_t *d;
+
+			if (getblock(g, r, c) == ' ')
+				continue;
+			d = &DROPS(g)[g->numdrops++];
+			d->col  = (unsigned char)c;
+			d->from = (unsigned char)r;
+			d->to   = (unsigned char)to;
+			to--;
+			left--;
+		}
+	}
+	TRACE_END("compactcolumns");
 }
 
 /* move down a row any blocks that are above spaces,
    returning 1 if any are moved */
-static int enforcegravity(void)
+int enforcegravity(game_t *g)
 {
-	int r, c;
+	int i;
 	int anymoved = 0;
 
-	for (r = height - 1; r >= 3; r--)
-	for (c = width  - 1; c >= 0; c--)
+	TRACE_BEGIN("enforcegravity");
+	g->dropstep++;
+	if (g->big != NULL)
+		anymoved = biggravity(g);
+
+	/* the moves for each column go from the bottom up, so the row
+	   below a block is always free by the time it gets lowered */
+	for (i = 0; i < g->numdrops; i++)
 	{
-		if (canfall(r, c))
+		const drop_t *d = &DROPS(g)[i];
+
+		if (d->to - d->from >= g->dropstep)
 		{
-			lower(r, c);
+			lower(g, d->from + g->dropstep - 1, d->col);
 			anymoved = 1;
 		}
 	}
+	TRACE_END("enforcegravity");
 	return anymoved;
 }
 
-static void pausegame(void)
+/* move every block straight to where it's going to land */
+static void collapsecolumns(game_t *g)
 {
-	(void)nodelay(stdscr, FALSE); /* do wait this time */
-	(void)getch();
-	(void)nodelay(stdscr, TRUE);  /* now stop delaying for input */
+	int i;
+
+	TRACE_BEGIN("collapsecolumns");
+	if (g->big != NULL)
+		bigcollapse(g);
+	for (i = 0; i < g->numdrops; i++)
+	{
+		const drop_t *d = &DROPS(g)[i];
+		moveblock(g, d->from, d->col, d->to, d->col);
+	}
+	TRACE_END("collapsecolumns");
 }
 
-/* devour all input up to a 'q' (in which case return 1) or the end of
-   the pending input (in which case return 0) */
-static int wantstoquit(void)
+/* the blocks have come to rest; blink any matches or start a new fall */
+static void settle(game_t *g)
 {
-	int ch;
-	int pausenow = 0;
+	if (findmatches(g))
+	{
+		g->state = STATE_BLINK;
+		g->blinkcount = 0;
+		g->chain++;
+	}
+	else
+	{
+		g->lastchain = g->chain;
+		startfall(g);
+	}
+}
 
-	while ((ch = getch()) != ERR)
+static void dofall(game_t *g)
+{
+	if (!makeblocksfall(g))
 	{
-		if (ch == 'q')
-			return 1;
-		else if (ch == 'p')
-			pausenow = 1;
+		/* no more falling is to be done */
+
+		g->scorebonus = 0;
+		g->chain = 0;
+
+		if (g->fallrow < HIDDEN_ROWS) /* above visible playfield */
+			g->state = STATE_GAMEOVER;
+		else
+			settle(g);
 	}
+}
 
-	if (pausenow)
-		pausegame();
+static void doblink(game_t *g)
+{
+	g->blinkcount++;
+	if (g->blinkcount == BLINK_TIMES)
+	{
+		g->blinkcount = 0;
+		g->state = STATE_GRAVITY;
+		destroyblinkers(g);
+		compactcolumns(g);
+	}
+	else
+		touchblinkers(g);
+}
 
-	return 0; /* nope, the player doesn't want to quit just yet */
+static void dogravity(game_t *g)
+{
+	if (g->quickgravity)
+		collapsecolumns(g);
+
+	if (g->quickgravity || !enforcegravity(g))
+	{
+		if (g->scorebonus < SCOREBONUS_MAX)
+			g->scorebonus++;
+		settle(g);
+	}
 }
 
-static void dofall(void)
+/* how many bytes a game with a w by h playfield takes; a big one keeps
+   its playfield elsewhere */
+size_t gamesize(int w, int h)
 {
-	long timeleft;
+	size_t rows = (size_t)(h + HIDDEN_ROWS);
+
+	if (w > MAX_WIDTH || h > MAX_HEIGHT)
+		return sizeof (game_t);
+	return sizeof (game_t)
+		+ (rows * (size_t)w + 7) / 8 * 8
+		+ (BLOCKTYPES + 3) * rows * sizeof (uint64_t)
+		+ rows * (size_t)w * sizeof (drop_t)
+		+ 2 * (size_t)w;
+}
 
-	(void)delay(falldelay); /* set a delay */
+/* a new game on a w by h playfield, with the first 1x3 block already
+   falling; the same seed always gives the same blocks; return NULL if
+   there isn't memory for it */
+game_t *startgame(int w, int h, unsigned long seed)
+{
+	size_t size = gamesize(w, h);
+	game_t *g;
 
-	while ((timeleft = delay(-1)) > 20)
+	if ((g = calloc(1, size)) == NULL)
+		return NULL;
+	g->size = size;
+	if (w <= MAX_WIDTH && h <= MAX_HEIGHT)
 	{
-		int ch;
+		size_t rows = (size_t)(h + HIDDEN_ROWS), cells = rows * w;
+
+		g->planesat  = (unsigned short)((cells + 7) / 8);
+		g->changedat = (unsigned short)(g->planesat
+			+ BLOCKTYPES * rows);
+		g->blinkat   = (unsigned short)(g->changedat + rows);
+		g->dirtyat   = (unsigned short)(g->blinkat + rows);
+		g->dropsat   = (unsigned short)((g->dirtyat + rows) * 8);
+		g->colsat    = (unsigned short)(g->dropsat
+			+ cells * sizeof (drop_t));
+	}
 
-		if (timeleft < FALL_DELAY_ACCEL)
-			millisleep(18);
-		else
-			millisleep(FALL_DELAY_ACCEL);
+	g->score       = 0;
+	g->level       = 0;
+	g->nextlevel   = tolevel[0];
+	g->falldelay   = FALL_DELAY_INITIAL;
+	g->fallspecial = ' ';
+	blocksdestroyed(g, 1);
 
-		while ((ch = getch()) != ERR)
+	g->width  = w;
+	g->height = h + HIDDEN_ROWS;
+
+	seedrandom(g, seed);
+	if (w > MAX_WIDTH || h > MAX_HEIGHT)
+	{
+		/* it starts out empty */
+		if ((g->big = newbig(g->width, g->height)) == NULL)
 		{
-			if (ch == KEY_LEFT || ch == 'h')
-			{
-				if (movefallingblocks(-1))
-					drawscreen();
-			}
-			else if (ch == KEY_RIGHT || ch == 'l')
-			{
-				if (movefallingblocks(+1))
-					drawscreen();
-			}
-			else if (ch == KEY_UP || ch == 'k')
-			{
-				shuffleblocks();
-				drawscreen();
-			}
-			else if (ch == KEY_DOWN || ch == 'j')
-			{
-				if (makeblocksfall())
-					drawscreen();
-			}
-			else if (ch == 'q') /* quit the game */
-			{
-				state = STATE_GAMEOVER;
-				return;
-			}
-			else if (ch == 'p')
-				pausegame();
+			free(g);
+			return NULL;
 		}
 	}
+	else
+	{
+#ifndef PACKEDCELLS
+		(void)memset(CELLS(g), ' ', (size_t)g->height * g->width);
+#endif
+		emptyblocks(g);
+	}
+	startfall(g);
+	return g;
+}
 
-	if (timeleft)
-		(void)delay(0); /* finish the delay */
+/* let go of g and anything startgame() had to allocate for it; copies
+   are just freed */
+void endgame(game_t *g)
+{
+	if (g->big != NULL)
+		freebig(g->big);
+	free(g);
+}
+
+/* a copy of g, or NULL if there isn't memory for one */
+game_t *dupgame(const game_t *g)
+{
+	game_t *copy;
+
+	if ((copy = malloc(g->size)) != NULL)
+		copygame(copy, g);
+	return copy;
+}
 
-	if (!makeblocksfall())
+/* make to a copy of from; to must have room for from->size bytes,
+   which another game of the same size always has */
+void copygame(game_t *to, const game_t *from)
+{
+	(void)memcpy(to, from, from->size);
+}
+
+/* the player does something to the falling blocks; return 1 if that
+   changed anything */
+int gameinput(game_t *g, gameinput_t in)
+{
+	if (g->state != STATE_FALL)
+		return 0;
+
+	switch (in)
 	{
-		/* no more falling is to be done */
+	case INPUT_LEFT:
+		return movefallingblocks(g, -1);
+	case INPUT_RIGHT:
+		return movefallingblocks(g, +1);
+	case INPUT_SHUFFLE:
+		shuffleblocks(g);
+		return 1;
+	case INPUT_DOWN:
+		return makeblocksfall(g);
+	}
+	return 0;
+}
+
+/*
+	Drop g's falling blocks the rest of the way and play out the chain
+reaction they set off, all at once and with no animation, until the
+next 1x3 block starts falling; return 0 if the game ends instead. The
+game ends up just as it would calling gametick() with quickgravity,
+ticks included, but without the blinking. What each round of matches
+did goes in c, if it's not NULL.
+*/
+int resolvefall(game_t *g, cascade_t *c)
+{
+	cascade_t ignored;
+	cascadestep_t spare;
+	int score = g->score;
+	long destroyed;
+
+	if (c == NULL)
+		c = &ignored;
+	c->steps = c->score = c->cleared = 0;
+	if (g->state != STATE_FALL)
+		return g->state != STATE_GAMEOVER;
+
+	TRACE_BEGIN("resolvefall");
+
+	/* a tick for each row they fall, and the one they land on */
+	while (makeblocksfall(g))
+		g->ticks++;
+	g->ticks++;
+	g->scorebonus = 0;
+	g->chain = 0;
+	if (g->fallrow < HIDDEN_ROWS)
+	{
+		g->state = STATE_GAMEOVER;
+		TRACE_END("resolvefall");
+		return 0;
+	}
 
-		scorebonus = 0;
+	/* each round takes BLINK_TIMES ticks of blinking and one of
+	   gravity */
+	while (findmatches(g))
+	{
+		cascadestep_t *step = g->chain < CASCADE_STEPS
+			? &c->step[g->chain] : &spare;
+
+		step->scorebonus = g->scorebonus;
+		destroyed = g->destroyed;
+		destroyblinkers(g);
+		compactcolumns(g);
+		collapsecolumns(g);
+		step->cleared = (int)(g->destroyed - destroyed);
+		c->cleared += step->cleared;
+
+		if (g->scorebonus < SCOREBONUS_MAX)
+			g->scorebonus++;
+		g->chain++;
+		g->ticks += BLINK_TIMES + 1;
+	}
 
-		if (fallrow < 3) /* above visible playfield */
-			state = STATE_GAMEOVER;
-		else if (findmatches())
-		{
-			state = STATE_BLINK;
-			blinkcount = 0;
-		}
-		else
-			startfall();
+	c->steps = g->lastchain = g->chain;
+	c->score = g->score - score;
+	startfall(g);
+	TRACE_END("resolvefall");
+	return 1;
+}
+
+/* advance the game by one step of whatever state it's in */
+void gametick(game_t *g)
+{
+	if (g->state == STATE_FALL)
+	{
+		TRACE_BEGIN("fall");
+		dofall(g);
+		TRACE_END("fall");
+	}
+	else if (g->state == STATE_BLINK)
+	{
+		TRACE_BEGIN("blink");
+		doblink(g);
+		TRACE_END("blink");
+	}
+	else if (g->state == STATE_GRAVITY)
+	{
+		TRACE_BEGIN("gravity");
+		dogravity(g);
+		TRACE_END("gravity");
 	}
 	else
-		drawscreen();
+		return;
+
+	g->ticks++;
 }
 
-static void doblink(void)
+/* how many ms should pass before the next gametick() */
+int tickdelay(const game_t *g)
 {
-	millisleep(BLINK_DELAY);
-	blinkcount++;
-	if (blinkcount == BLINK_TIMES)
+	switch (g->state)
 	{
-		blinkcount = 0;
-		state = STATE_GRAVITY;
-		destroyblinkers();
+	case STATE_FALL:
+		return g->falldelay;
+	case STATE_BLINK:
+		return BLINK_DELAY;
+	case STATE_GRAVITY:
+		return FALL_DELAY_GRAVITY;
+	default:
+		return 0;
 	}
-	if (blinkcount & 1)
-		hideblinkers();
-	else
-		showblinkers();
-	updatescreen();
+}
 
-	if (wantstoquit())
-		state = STATE_GAMEOVER;
+/* how many blocks have to be destroyed on level to go up to the next */
+int levelblocks(int level)
+{
+	return tolevel[level];
+}
+
+/* how many blocks there are in the playfield */
+int countblocks(const game_t *g)
+{
+	int n = 0;
+	int t;
+
+	for (t = 0; t < BLOCKTYPES; t++)
+		n += g->typecount[t];
+	return n;
 }
 
-static void dogravity(void)
+/* what's in the playfield at row, col (rows count from the top of the
+   hidden rows) */
+char blockat(const game_t *g, int row, int col)
 {
-	millisleep(FALL_DELAY_GRAVITY);
+	return getblock(g, row, col);
+}
 
-	if (!enforcegravity())
+/* what should be on the screen at row, col: the same as blockat(),
+   except blinking blocks are invisible half of the time */
+char shownblock(const game_t *g, int row, int col)
+{
+	if (g->state == STATE_BLINK && (g->blinkcount & 1)
+		&& blinkingat(g, row, col))
 	{
-		if (scorebonus < SCOREBONUS_MAX)
-			scorebonus++;
-		if (findmatches())
-		{
-			state = STATE_BLINK;
-			blinkcount = 0;
-		}
-		else
-			startfall();
+		return ' ';
 	}
-	else
-		drawscreen();
+	return getblock(g, row, col);
+}
+
+/* return 1 if row, col has to be redrawn, and consider it redrawn */
+int takechange(game_t *g, int row, int col)
+{
+	if (cleanat(g, row, col))
+		return 0;
+	putclean(g, row, col, 1);
+	return 1;
+}
+
+/* which of the n (up to 64) cells from row, col on have to be
+   redrawn, as a bit for each from the lowest up, and consider them
+   redrawn */
+uint64_t takechanges(game_t *g, int row, int col, int n)
+{
+	uint64_t all = n < 64 ? ((uint64_t)1 << n) - 1 : ~(uint64_t)0;
+	uint64_t m = 0;
+	int i;
 
-	if (wantstoquit())
-		state = STATE_GAMEOVER;
+	if (g->big == NULL)
+	{
+		m = (DIRTYBITS(g)[row] >> col) & all;
+		DIRTYBITS(g)[row] &= ~(m << col);
+		return m;
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (takechange(g, row, col + i))
+			m |= (uint64_t)1 << i;
+	}
+	return m;
 }
 
-void playgame(int w, int h)
+/* have every cell drawn again */
+void touchall(game_t *g)
 {
-	score      = 0;
-	level      = 0;
-	blockcount = 1;
-	nextlevel  = tolevel[0];
-	falldelay  = FALL_DELAY_INITIAL;
-	blocksdestroyed(1);
+	int r, c;
+
+	if (g->big == NULL)
+	{
+		for (r = 0; r < g->height; r++)
+			DIRTYBITS(g)[r] = ((uint64_t)1 << g->width) - 1;
+		return;
+	}
+	for (r = 0; r < g->height; r++)
+	for (c = 0; c < g->width; c++)
+		putclean(g, r, c, 0);
+}
 
-	width  = w;
-	height = h + 3; /* the extra 3 are at the top, not visible */
+/*
+	Snapshots, for trying moves out and taking them back. Once a game
+is keeping its changes in u, savegame() copies just the few parts of it
+that change with every move, and restoregame() undoes every change kept
+since (the blocks, and the rarer changes to the level) and copies the
+rest back. Snapshots work like a stack: going
+back to one forgets every snapshot taken after it.
+*/
 
-	srandom((unsigned int)time(NULL));
-	emptyblocks();
-	starttimer();
-	startfall();
+/* start keeping g's changes in u, or stop if u is NULL; the changes to
+   a big playfield can't be kept */
+void keepchanges(game_t *g, undo_t *u)
+{
+	if (g->big != NULL)
+		u = NULL;
+	g->undo = u;
+	if (u != NULL)
+	{
+		u->count = 0;
+		u->lost = 0;
+		u->epoch = 1;
+		(void)memset(u->stamp, 0, sizeof u->stamp);
+	}
+}
 
-	drawborders(w, h);
-	drawlevel(1);
-	drawscore(0);
-	updatescreen();
+void freeundo(undo_t *u)
+{
+	free(u->changes);
+	u->changes = NULL;
+	u->count = u->size = 0;
+}
 
-	while (state != STATE_GAMEOVER)
+/* start a new epoch: every cell's next change has to be kept */
+static void newepoch(undo_t *u)
+{
+	if (++u->epoch == 0)
 	{
-		if (state == STATE_FALL)
-			dofall();
-		else if (state == STATE_BLINK)
-			doblink();
-		else if (state == STATE_GRAVITY)
-			dogravity();
+		(void)memset(u->stamp, 0, sizeof u->stamp);
+		u->epoch = 1;
 	}
+}
 
-	drawscreen();
-	millisleep(1000);
+void savegame(game_t *g, snapshot_t *s)
+{
+	int i;
+
+	s->hash        = g->hash;
+	s->rng         = g->rng;
+	s->holecols    = g->holecols;
+	s->ticks       = g->ticks;
+	s->pieces      = g->pieces;
+	s->destroyed   = g->destroyed;
+	s->mark        = 0;
+	if (g->undo != NULL)
+	{
+		s->mark = g->undo->count;
+		newepoch(g->undo);
+	}
+	s->score       = g->score;
+	s->nextlevel   = g->nextlevel;
+	s->scorebonus  = g->scorebonus;
+	s->blinkcount  = g->blinkcount;
+	s->chain       = g->chain;
+	s->lastchain   = g->lastchain;
+	s->numdrops    = (short)g->numdrops;
+	s->state       = (unsigned char)g->state;
+	s->fallcol     = (unsigned char)g->fallcol;
+	s->fallrow     = (unsigned char)g->fallrow;
+	s->dropstep    = (unsigned char)g->dropstep;
+	s->fallspecial = g->fallspecial;
+
+	/* blocks still falling will need to know where to, but the list
+	   gets written over the next time anything is destroyed */
+	if (g->undo != NULL && g->state == STATE_GRAVITY)
+	{
+		for (i = 0; i < g->numdrops; i++)
+		{
+			const drop_t *d = &DROPS(g)[i];
+			keep(g, UNDO_DROP, d->from, d->col, (char)d->to,
+				(uint64_t)i);
+		}
+	}
+}
+
+/* put g back the way it was when s was saved; return 0 if that can't
+   be done, because g wasn't keeping its changes or couldn't keep them
+   all */
+int restoregame(game_t *g, const snapshot_t *s)
+{
+	undo_t *u = g->undo;
+
+	if (u == NULL || u->lost || u->count < s->mark)
+		return 0;
+
+	while (u->count > s->mark)
+	{
+		const change_t *c = &u->changes[--u->count];
+		drop_t *d;
+
+		switch (c->kind)
+		{
+		case UNDO_BLOCK:
+			putback(g, c->row, c->col, c->old);
+			CHANGED(g)[c->row] = c->word;
+			break;
+		case UNDO_BLINK:
+			putblinking(g, c->row, c->col, c->old);
+			putclean(g, c->row, c->col, 0);
+			break;
+		case UNDO_CHANGED:
+			CHANGED(g)[c->row] = c->word;
+			break;
+		case UNDO_DROP:
+			d = &DROPS(g)[c->word];
+			d->col  = c->col;
+			d->from = c->row;
+			d->to   = (unsigned char)c->old;
+			break;
+		case UNDO_LEVEL:
+			g->level     = (int)(uint32_t)(c->word >> 32);
+			g->falldelay = (int)(uint32_t)c->word;
+			break;
+		case UNDO_DESTLEV:
+			g->destlevel = (int)(uint32_t)c->word;
+			break;
+		}
+	}
+	newepoch(u);
+
+	g->hash        = s->hash;
+	g->rng         = s->rng;
+	g->holecols    = s->holecols;
+	g->ticks       = s->ticks;
+	g->pieces      = s->pieces;
+	g->destroyed   = s->destroyed;
+	g->score       = s->score;
+	g->nextlevel   = s->nextlevel;
+	g->scorebonus  = s->scorebonus;
+	g->blinkcount  = s->blinkcount;
+	g->chain       = s->chain;
+	g->lastchain   = s->lastchain;
+	g->numdrops    = s->numdrops;
+	g->state       = (gamestate_t)s->state;
+	g->fallcol     = s->fallcol;
+	g->fallrow     = s->fallrow;
+	g->dropstep    = s->dropstep;
+	g->fallspecial = s->fallspecial;
+	return 1;
 }
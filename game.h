@@ -0,0 +1,437 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+game.h: the game engine, which knows nothing about screens, keyboards
+        or clocks
+*/
+
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#define MAX_WIDTH   50
+#define DEF_WIDTH   10
+#define MIN_WIDTH    8
+
+#define MAX_HEIGHT  30
+#define DEF_HEIGHT  15
+#define MIN_HEIGHT  10
+
+#define CH_BLOCKS "%@#$&O"              /* blocks; first one is special */
+#define NUMBLOCKS (strlen(CH_BLOCKS)-1) /* % doesn't count */
+#define BLOCKTYPES 6                    /* strlen(CH_BLOCKS) */
+
+/* with -DPACKEDCELLS (see the Makefile), each cell holds the type of
+   its block rather than the character it's drawn with */
+
+/* how a cell is packed into a byte, with PACKEDCELLS and always in big
+   playfields: just its block. A big playfield's cells keep flags of
+   their own in the bits above (see big.c); everyone else keeps them
+   apart, as bit rows in the game's store. */
+#define CELL_TYPE  0x07 /* type of block + 1, or 0 for no block */
+
+/* playfields wider than MAX_WIDTH or taller than MAX_HEIGHT, up to
+   BIG_MAX either way, are big ones, kept on the heap (see big.c) */
+#define BIG_MAX   4096
+
+/*
+A Columns game in progress can be in one of three states at a particular
+time:
+
+1. Controlled falling:
+
+	A 1x3 block is falling. The player can move it to the left, move
+it to the right, shift the 1x1 blocks comprising it, or speed its
+descent.
+
+	The blocks move down a row every d milliseconds, where d is some
+number (which gets smaller as the game progresses). When it is time for
+the blocks to move again but they can move no further due to blocks
+below them, either one of the blocks is above the visible top of the
+playing field and the game ends, or there are some blocks to destroy and
+the game goes to state 2, or there are no blocks to destroy and the game
+returns to this state with a new 1x3 block.
+
+2. Blinking:
+
+	Some blocks are to be destroyed. They are blinking; every b
+milliseconds they disappear or reappear. The blinking occurs t times. b
+and t are some constants.
+
+	After the blinking is done, the blocks to be destroyed are
+destroyed and the state goes to 3.
+
+3. Uncontrolled falling:
+
+	Any blocks that are now above space fall. They fall at a rate of
+one row every d' milliseconds. I think d' is a constant that is less
+than the initial value of d, but it might be the same as d itself.
+
+	When it is time for blocks to fall but none have space to fall
+into, either more blocks need destroying and the state goes to 2, or no
+blocks are left to be destroyed and the state goes to 1.
+
+So: we need constants b and t, and a variable d, and a constant d'.
+
+The engine never sleeps. Each call to gametick() performs one step of
+the current state (one row of falling, one blink, or one row of
+gravity), and tickdelay() says how many milliseconds the front end
+should let pass before the next one. Something that doesn't care about
+real time, like a simulation, can just call gametick() in a loop.
+*/
+
+#define BLINK_DELAY          33
+#define BLINK_TIMES           8
+
+#define DELAY_DECREASE       31
+
+/* initial: starting fall delay for a normal fall
+   gravity: delay for a fall induced by gravity (non-interactive)
+   accel:   delay for when the player is holding the down arrow key */
+#define FALL_DELAY_INITIAL (355 + DELAY_DECREASE)
+#define FALL_DELAY_GRAVITY   50
+#define FALL_DELAY_ACCEL     50
+
+/* destroyer blocks are the %%% blocks that occasionally come down and
+   destroy all blocks of the color they land on
+   window:   how many values for "number of blocks to next level" during
+             which a destroyer block is possible
+   minlevel: never drop a destroyer block on a lower level than this
+   mincount: minimum number of blocks in playing field to drop a
+             destroyer block
+   chance:   the chance of dropping a destroyer block when the above
+             conditions are met is 1 in this many */
+#define DESTROYER_BLOCK_WINDOW    8
+#define DESTROYER_BLOCK_MINLEVEL  2
+#define DESTROYER_BLOCK_MINCOUNT 16
+#define DESTROYER_BLOCK_CHANCE    3
+
+/* when the "destroyer block window" starts and ends */
+#define DESTROYER_BLOCK_WINSTART 22
+#define DESTROYER_BLOCK_WINEND \
+	(DESTROYER_BLOCK_WINSTART + DESTROYER_BLOCK_WINDOW)
+
+/*
+	When you destroy numblocks blocks at a time, you get (numblocks *
+(level + scorebonus)) points, where level is your level number (1 to 10),
+and scorebonus is 0 for blocks destroyed by a direct match. This formula
+is not from the original Columns but seems to work fairly well.
+
+	Every time there is a chain reaction (e.g. gravity causes more
+blocks to match and be eliminated), scorebonus is incremented by one,
+until it reaches the following, its maximum value.
+*/
+#define SCOREBONUS_MAX            4
+
+/* the playfield has this many invisible rows at the top, where a new
+   1x3 block starts out */
+#define HIDDEN_ROWS               3
+
+typedef enum
+{
+	STATE_FALL,
+	STATE_BLINK,
+	STATE_GRAVITY,
+	STATE_GAMEOVER
+} gamestate_t;
+
+/* what the player can do to the falling blocks */
+typedef enum
+{
+	INPUT_LEFT,
+	INPUT_RIGHT,
+	INPUT_SHUFFLE,
+	INPUT_DOWN
+} gameinput_t;
+
+/* a block that falls after blocks below it are destroyed */
+typedef struct
+{
+	unsigned char col;
+	unsigned char from; /* row it starts in */
+	unsigned char to;   /* row it lands in */
+} drop_t;
+
+/* one change to a game's blocks, kept so that it can be undone */
+typedef struct
+{
+	uint64_t word;      /* the row of changed bits before, the index
+	                       of a drop, or the level before */
+	unsigned char kind;
+	unsigned char row;
+	unsigned char col;
+	char old;           /* what was in the cell before */
+} change_t;
+
+typedef struct bigboard bigboard_t;
+
+/* the changes made to a game since it started keeping them; a cell
+   only needs its first change after each snapshot kept, and stamp
+   says which snapshot (counting restores too) a cell last had one
+   kept for */
+typedef struct
+{
+	change_t *changes;
+	size_t count;
+	size_t size;
+	int lost;           /* there wasn't memory to keep one */
+	uint32_t epoch;
+	uint32_t stamp[MAX_HEIGHT+HIDDEN_ROWS][MAX_WIDTH];
+} undo_t;
+
+/*
+	Everything about one game in progress; there can be any number of
+these at once. The playfield itself is in store, at the end, which is
+only as big as a playfield of the game's size needs, so a game is a
+couple of kilobytes at the default size rather than as big as the
+biggest: startgame() allocates a game and its store together, and a
+game is copied by copying g->size bytes of it (see copygame()). What's
+in store is found with the macros below.
+*/
+typedef struct
+{
+	gamestate_t state;
+
+	int width;
+	int height; /* including the HIDDEN_ROWS at the top */
+
+	/* Zobrist hash of the playfield, kept up to date by setblock();
+	   always 0 for a big playfield */
+	uint64_t hash;
+
+	/* how many blocks of each type are in the playfield (hidden rows
+	   included), also kept up to date by setblock() */
+	int typecount[BLOCKTYPES];
+
+	/* where blocks fall during STATE_GRAVITY (DROPS()), worked out as
+	   soon as the blinking blocks are destroyed; the blocks have
+	   fallen dropstep rows so far (or all the way, with
+	   quickgravity) */
+	int numdrops;
+	int dropstep;
+	uint64_t holecols;  /* columns that had blocks destroyed, and the
+	                       lowest row in each is in LOWHOLE() */
+
+	int quickgravity;   /* set to drop blocks in one tick, unanimated */
+	int threads;        /* how many threads can find matches on a big
+	                       playfield (0 or 1 for just the caller's) */
+
+	int fallcol;      /* column of the 1x3 falling blocks */
+	int fallrow;      /* top row of the 1x3 falling blocks */
+	char fallspecial; /* what the %%% block fell on */
+
+	int falldelay;
+	int blinkcount;
+
+	int level;
+	int score;
+	int nextlevel;
+	int destlevel;    /* last level on which a destroyer block fell */
+	int scorebonus;
+
+	long ticks;       /* calls to gametick() so far */
+	long pieces;      /* 1x3 blocks dropped so far */
+	long destroyed;   /* blocks destroyed so far */
+	int chain;        /* matches so far in the current chain reaction */
+	int lastchain;    /* matches the last 1x3 block set off */
+
+	uint64_t rng;     /* state of the random number generator */
+
+	undo_t *undo;     /* where changes to the blocks are kept, if
+	                     anywhere; a copy of a game must not share it */
+
+	bigboard_t *big;  /* for a big playfield, where its cells are
+	                     instead, with nothing in store; the same goes
+	                     for copies */
+
+	size_t size;      /* bytes in all, store included */
+	unsigned short planesat, changedat, blinkat, dirtyat; /* words and */
+	unsigned short dropsat, colsat;        /* bytes into store, see below */
+	uint64_t store[];
+} game_t;
+
+/* what's in g's store: first each cell's block in a byte, row after
+   row of width cells */
+#define CELLS(g)      ((unsigned char *)(g)->store)
+
+/* then a word of bits for each row of the playfield, a bit for each
+   cell, in each of: one bit plane per type of block (see bitboard.c) */
+#define PLANES(g, t)  ((g)->store + (g)->planesat \
+	+ (size_t)(t) * (g)->height)
+
+/* the blocks put down since matches were last looked for */
+#define CHANGED(g)    ((g)->store + (g)->changedat)
+
+/* the cells that are blinking */
+#define BLINKBITS(g)  ((g)->store + (g)->blinkat)
+
+/* and the cells that have changed since they were last drawn */
+#define DIRTYBITS(g)  ((g)->store + (g)->dirtyat)
+
+/* then where blocks fall, numdrops of them; there can't be more than
+   there are cells */
+#define DROPS(g)      ((drop_t *)((unsigned char *)(g)->store + (g)->dropsat))
+
+/* how many blocks are in each column; apart from during STATE_GRAVITY,
+   they're all at the bottom, so this is the column's height */
+#define COLBLOCKS(g)  ((unsigned char *)(g)->store + (g)->colsat)
+
+/* and the lowest row with a block destroyed in each of holecols */
+#define LOWHOLE(g)    (COLBLOCKS(g) + (g)->width)
+
+/*
+	What savegame() has to copy to take a snapshot: the parts of a game
+that change with nearly every move. The blocks, and the counts of them
+in typecount and COLBLOCKS(), are put back by undoing the changes made
+to them since, and so are the level and falldelay, which change once a
+level, and destlevel; so going back costs as much as the moves made
+since, not as much as the whole game.
+*/
+typedef struct
+{
+	uint64_t hash;
+	uint64_t rng;
+	uint64_t holecols;
+	long ticks;
+	long pieces;
+	long destroyed;
+	size_t mark;      /* how many changes had been kept */
+	int score;
+	int nextlevel;
+	int scorebonus;
+	int blinkcount;
+	int chain;
+	int lastchain;
+	short numdrops;
+	unsigned char state;
+	unsigned char fallcol;
+	unsigned char fallrow;
+	unsigned char dropstep;
+	char fallspecial;
+} snapshot_t;
+
+/*
+	What resolvefall() found playing out a chain reaction: each step is
+one round of matches being destroyed and the blocks above them falling.
+*/
+#define CASCADE_STEPS 16 /* steps kept; longer chains are still counted */
+
+typedef struct
+{
+	int cleared;    /* blocks destroyed */
+	int scorebonus; /* points each scored on top of the level's */
+} cascadestep_t;
+
+typedef struct
+{
+	int steps;      /* rounds of matches (what game_t.lastchain gets) */
+	int score;      /* points scored */
+	int cleared;    /* blocks destroyed */
+	cascadestep_t step[CASCADE_STEPS];
+} cascade_t;
+
+game_t *startgame(int w, int h, unsigned long seed);
+void endgame(game_t *g);
+size_t gamesize(int w, int h);
+game_t *dupgame(const game_t *g);
+void copygame(game_t *to, const game_t *from);
+int gameinput(game_t *g, gameinput_t in);
+void gametick(game_t *g);
+int tickdelay(const game_t *g);
+int resolvefall(game_t *g, cascade_t *c);
+
+char blockat(const game_t *g, int row, int col);
+char shownblock(const game_t *g, int row, int col);
+int takechange(game_t *g, int row, int col);
+uint64_t takechanges(game_t *g, int row, int col, int n);
+void touchall(game_t *g);
+
+void keepchanges(game_t *g, undo_t *u);
+void freeundo(undo_t *u);
+void savegame(game_t *g, snapshot_t *s);
+int restoregame(game_t *g, const snapshot_t *s);
+
+/* the steps gametick() is made of, for benchmarks and other tools that
+   set up boards of their own */
+void setblock(game_t *g, int row, int col, char content);
+int findmatchesfrom(game_t *g, int row, int col);
+int findmatches(game_t *g);
+void destroyblinkers(game_t *g);
+void compactcolumns(game_t *g);
+int enforcegravity(game_t *g);
+int levelblocks(int level);
+int countblocks(const game_t *g);
+int stackheight(const game_t *g, int col);
+void changeall(game_t *g);
+
+/* big.c */
+bigboard_t *newbig(int w, int h);
+void freebig(bigboard_t *b);
+unsigned char *bigcell(bigboard_t *b, int row, int col);
+void bigput(bigboard_t *b, int row, int col, int oldtype, int newtype);
+void bigblink(bigboard_t *b, int row, int col, int on);
+int bigblinking(bigboard_t *b, int row, int col);
+int bigclean(bigboard_t *b, int row, int col);
+void bigsetclean(bigboard_t *b, int row, int col, int on);
+void bigtouchblinkers(bigboard_t *b);
+void bigchangeall(bigboard_t *b);
+int bigspecial(game_t *g, int t);
+int bigcolumn(const bigboard_t *b, int col);
+int bigmatches(game_t *g);
+int bigdestroy(game_t *g);
+void bigcompact(game_t *g);
+int biggravity(game_t *g);
+void bigcollapse(game_t *g);
+
+/* bitboard.c */
+void bbruns(const uint64_t *plane, int rows, uint64_t *marks);
+
+/* policy.c */
+typedef struct
+{
+	int col;      /* column to drop the falling blocks in */
+	int shuffles; /* how many times to shuffle them first */
+} move_t;
+
+/* a policy picks a move for the 1x3 block that has just started
+   falling in g; rng is random state of its own */
+typedef void (*policy_t)(const game_t *g, uint64_t *rng, move_t *m);
+
+policy_t findpolicy(const char *name);
+void playmove(game_t *g, const move_t *m);
+
+/* the "lookahead" policy's depth; lookahead() can go deeper, and use
+   more threads to do it */
+#define LOOKAHEAD_DEPTH 2
+
+void lookahead(const game_t *g, int depth, int threads, uint64_t *rng,
+	move_t *m);
+
+/* lanes.c */
+#define LANES       32 /* games played at once */
+#define LANE_WIDTH  16 /* the widest playfield they can have */
+#define LANE_CHAINS 16 /* longer chain reactions are counted as 15 */
+
+/* how one game played by playlanes() went */
+typedef struct
+{
+	long index;
+	int score;
+	int level;
+	long destroyed;
+	long ticks;
+	long pieces;
+	int over;                  /* 0 if it was stopped at maxticks */
+	long chains[LANE_CHAINS];  /* 1x3 blocks setting off n matches */
+} laneresult_t;
+
+typedef void (*lanedone_t)(const laneresult_t *r, void *arg);
+
+int playlanes(int w, int h, unsigned long seed, long first, long count,
+	long maxticks, lanedone_t done, void *arg);
+
+#endif
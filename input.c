@@ -0,0 +1,179 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+input.c: reading keys on a thread of its own
+*/
+
+#include "columns.h"
+
+#include <pthread.h>
+
+/*
+	A thread does nothing but wait for keys, so a key is seen the
+moment it arrives, whatever the game is doing, and stamped with the
+time it was seen (monotime()). Keys go to the game's thread through a
+ring of QUEUE_SIZE events with one writer and one reader and no
+locking: the reader thread only moves head, the game's thread only
+moves tail, and each reads the other's with acquire ordering after
+the events it covers have been written. The game's thread takes keys
+from the front, but can look at any of them before taking them.
+
+	After putting keys in the ring, the reader thread writes a byte to
+a pipe, which is what the game's poll() waits on. A key that doesn't
+fit in the ring is thrown away.
+
+	When the terminal hangs up, or there's nothing more to read (stdin
+at end of file), poll() keeps saying there is, so the reader thread
+stops as soon as it gets woken up with no key to read, and says so
+through inputgone() and one last byte down the pipe. Part of an arrow
+key doesn't count as nothing: the thread waits a little for the rest
+(see readkeywait()).
+*/
+
+#define QUEUE_SIZE 256 /* a power of two */
+
+static keyevent_t queue[QUEUE_SIZE];
+static unsigned head = 0; /* where the next key goes */
+static unsigned tail = 0; /* the first key not taken yet */
+
+static pthread_t readthread;
+static int reading = 0;
+static int gone = 0; /* the reader thread stopped with no more keys */
+static int wakepipe[2] = { -1, -1 }; /* keys are waiting */
+static int stoppipe[2] = { -1, -1 }; /* the reader thread should stop */
+
+static void pushkey(int key, long long when)
+{
+	unsigned h = head;
+
+	if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == QUEUE_SIZE)
+		return;
+	queue[h % QUEUE_SIZE].key  = key;
+	queue[h % QUEUE_SIZE].when = when;
+	queue[h % QUEUE_SIZE].held = 0;
+	__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+}
+
+static void *readloop(void *arg)
+{
+	struct pollfd fds[2];
+	char c = 0;
+	int ch;
+
+	(void)arg;
+	fds[0].fd = STDIN_FILENO;
+	fds[1].fd = stoppipe[0];
+	fds[0].events = fds[1].events = POLLIN;
+	for (;;)
+	{
+		long long when;
+		int n = 0;
+
+		if (poll(fds, 2, readkeywait()) < 0)
+			continue;
+		if (fds[1].revents & POLLIN)
+			break;
+
+		/* everything read now arrived together */
+		when = monotime();
+		while ((ch = readkey()) != ERR)
+		{
+			pushkey(ch, when);
+			n++;
+		}
+		if (n == 0 && readkeywait() >= 0)
+			continue; /* only part of a key so far */
+		if (n == 0)
+		{
+			/* POLLHUP, POLLERR, or POLLIN with nothing to read */
+			__atomic_store_n(&gone, 1, __ATOMIC_RELEASE);
+			(void)write(wakepipe[1], &c, 1);
+			break;
+		}
+		(void)write(wakepipe[1], &c, 1);
+	}
+	return NULL;
+}
+
+/* start reading keys on a thread of their own; return 0 if that can't
+   be done */
+int startinput(void)
+{
+	sigset_t all, old;
+
+	if (reading)
+		return 1;
+	if (pipe(wakepipe) != 0)
+		return 0;
+	if (pipe(stoppipe) != 0)
+	{
+		(void)close(wakepipe[0]);
+		(void)close(wakepipe[1]);
+		return 0;
+	}
+	(void)fcntl(wakepipe[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(wakepipe[1], F_SETFL, O_NONBLOCK);
+	gone = 0;
+
+	/* signals are for the game's thread */
+	(void)sigfillset(&all);
+	(void)pthread_sigmask(SIG_SETMASK, &all, &old);
+	reading = pthread_create(&readthread, NULL, readloop, NULL) == 0;
+	(void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return reading;
+}
+
+/* stop reading keys */
+void stopinput(void)
+{
+	char c = 0;
+
+	if (!reading)
+		return;
+	(void)write(stoppipe[1], &c, 1);
+	(void)pthread_join(readthread, NULL);
+	(void)close(wakepipe[0]);
+	(void)close(wakepipe[1]);
+	(void)close(stoppipe[0]);
+	(void)close(stoppipe[1]);
+	reading = 0;
+}
+
+/* what to poll() for keys arriving; after it says there are some,
+   clearinput() before looking at them */
+int inputfd(void)
+{
+	return wakepipe[0];
+}
+
+void clearinput(void)
+{
+	char buf[64];
+
+	while (read(wakepipe[0], buf, sizeof buf) > 0)
+		;
+}
+
+/* 1 if no more keys are coming, because the terminal hung up or
+   stdin ran out; the ones already read can still be taken */
+int inputgone(void)
+{
+	return __atomic_load_n(&gone, __ATOMIC_ACQUIRE);
+}
+
+/* the i'th key not taken yet, from the front, or NULL if there aren't
+   that many */
+keyevent_t *keyat(int i)
+{
+	unsigned h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+	if (h - tail <= (unsigned)i)
+		return NULL;
+	return &queue[(tail + (unsigned)i) % QUEUE_SIZE];
+}
+
+/* be done with the first n keys */
+void takekeys(int n)
+{
+	__atomic_store_n(&tail, tail + (unsigned)n, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,487 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+lanes.c: playing LANES games at once with the random policy
+*/
+
+#include "game.h"
+
+/*
+	Most of what columns-sim does with the random policy is finding
+matches and letting blocks fall, and that is the same few operations
+on bit planes whatever the board looks like. So here the games are
+played side by side in lockstep: each plane row is LANE_WIDTH bits,
+and row r of a plane for all LANES games is one vector, lane i being
+game i's. One pass of bbruns() over the vectors finds the matches in
+every game at once, and gravity is a sweep up the rows moving every
+block that has a hole under it down by one, repeated until nothing
+moves.
+
+	The games go the way playmove() plays them with quickgravity, and
+come out exactly as they would there: the same random numbers, score,
+level, ticks and chain reactions. In each step every game either drops
+its next 1x3 block or plays the next round of the chain reaction the
+last one set off, so no game waits for another's chain reaction to
+end; lanes without a game are masked off. What is different in every
+game (random numbers, moves and scoring) is done lane by lane in plain
+C, and when a game ends its lane starts the next one.
+
+	The vector code is GCC's vector extensions, compiled for AVX2 and
+for plain x86-64 (SSE2), with the right one picked when the program
+starts; elsewhere it is whatever the compiler makes of it.
+*/
+
+#define ROWS (MAX_HEIGHT + HIDDEN_ROWS)
+
+typedef uint16_t lanevec_t __attribute__((vector_size(2 * LANES)));
+typedef uint64_t lanewords_t __attribute__((vector_size(2 * LANES)));
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define VECTORCODE __attribute__((target_clones("avx2", "default")))
+#else
+#define VECTORCODE
+#endif
+
+/* one game's own state */
+typedef struct
+{
+	int playing;      /* 0 for a lane with no game */
+	int settling;     /* its 1x3 block has landed, and is still setting
+	                     off matches */
+	laneresult_t r;
+	uint64_t rng;     /* the game's, as in game_t */
+	uint64_t policy;  /* the policy's */
+	int piece[3];     /* types of the 1x3 block, top first */
+	int col;
+	int special;      /* type the %%% block landed on, or -1 */
+	int level;
+	int nextlevel;
+	int blockcount;
+	int destlevel;
+	int scorebonus;
+	int chain;
+	int lastchain;
+} lane_t;
+
+typedef struct
+{
+	lanevec_t planes[BLOCKTYPES][ROWS];
+	lanevec_t occupied[ROWS];
+	lanevec_t marks[ROWS];
+	lanevec_t column;   /* the bit of each game's falling column */
+	lanevec_t bottom;   /* where each 1x3 block's bottom lands */
+	lanevec_t mask;     /* 0xffff in lanes looking for matches */
+	lanevec_t counts;   /* blocks each one has to destroy */
+
+	int width;
+	int height;
+	unsigned long seed;
+	long maxticks;
+	long next;          /* the next game to start */
+	long end;
+	lanedone_t done;
+	void *arg;
+	lane_t lane[LANES];
+} lanes_t;
+
+/* the same as game.c's and policy.c's random numbers */
+static unsigned long lanerandom(uint64_t *rng)
+{
+	*rng ^= *rng >> 12;
+	*rng ^= *rng << 25;
+	*rng ^= *rng >> 27;
+	return (unsigned long)((*rng * 2685821657736338717ULL) >> 33);
+}
+
+static uint64_t laneseed(unsigned long seed)
+{
+	uint64_t z = (uint64_t)seed + 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	return z != 0 ? z : 1;
+}
+
+/* is any bit of *v set? */
+static inline int anyset(const lanevec_t *v)
+{
+	lanewords_t w = (lanewords_t)*v;
+	uint64_t x = 0;
+	int i;
+
+	for (i = 0; i < LANES / 4; i++)
+		x |= w[i];
+	return x != 0;
+}
+
+/* the highest row with a block in any lane in mask */
+static inline int toprow(const lanes_t *L)
+{
+	lanevec_t v;
+	int r;
+
+	for (r = HIDDEN_ROWS; r < L->height; r++)
+	{
+		v = L->occupied[r] & L->mask;
+		if (anyset(&v))
+			break;
+	}
+	return r;
+}
+
+/* where the 1x3 block in lane i lands: the row its bottom ends up in */
+VECTORCODE static void findbottoms(lanes_t *L)
+{
+	lanevec_t found = { 0 };
+	lanevec_t bottom = found + (uint16_t)(L->height - 1);
+	int r;
+
+	for (r = HIDDEN_ROWS; r < L->height; r++)
+	{
+		lanevec_t hit = (lanevec_t)((L->occupied[r] & L->column) != 0)
+			& ~found;
+
+		bottom = (bottom & ~hit) | (hit & (uint16_t)(r - 1));
+		found |= hit;
+	}
+	L->bottom = bottom;
+}
+
+/* mark every block in a run of three in the lanes in mask, and count
+   them (each lane's special ones have been added to marks already) */
+VECTORCODE static void findruns(lanes_t *L)
+{
+	lanevec_t counts = { 0 };
+	int top = toprow(L);
+	int r, t;
+
+	for (t = 0; t < BLOCKTYPES; t++)
+	{
+		const lanevec_t *p = L->planes[t];
+
+		/* as bbruns() */
+		for (r = top; r < L->height; r++)
+		{
+			lanevec_t x = p[r] & (p[r] >> 1) & (p[r] >> 2);
+
+			L->marks[r] |= x | (x << 1) | (x << 2);
+			if (r + 2 >= L->height)
+				continue;
+
+			x = p[r] & p[r+1] & p[r+2];
+			L->marks[r]   |= x;
+			L->marks[r+1] |= x;
+			L->marks[r+2] |= x;
+
+			x = p[r] & (p[r+1] >> 1) & (p[r+2] >> 2);
+			L->marks[r]   |= x;
+			L->marks[r+1] |= x << 1;
+			L->marks[r+2] |= x << 2;
+
+			x = p[r] & (p[r+1] << 1) & (p[r+2] << 2);
+			L->marks[r]   |= x;
+			L->marks[r+1] |= x >> 1;
+			L->marks[r+2] |= x >> 2;
+		}
+	}
+
+	for (r = HIDDEN_ROWS; r < L->height; r++)
+	{
+		lanevec_t x = L->marks[r] & L->mask;
+
+		/* population count of each 16-bit lane */
+		L->marks[r] = x;
+		x = x - ((x >> 1) & 0x5555);
+		x = (x & 0x3333) + ((x >> 2) & 0x3333);
+		x = (x + (x >> 4)) & 0x0f0f;
+		counts += (x + (x >> 8)) & 0x1f;
+	}
+	L->counts = counts;
+}
+
+/* destroy the marked blocks and let everything above them fall */
+VECTORCODE static void collapse(lanes_t *L)
+{
+	lanevec_t moved;
+	int top = toprow(L), low = top;
+	int r, t;
+
+	for (r = top; r < L->height; r++)
+	{
+		for (t = 0; t < BLOCKTYPES; t++)
+			L->planes[t][r] &= ~L->marks[r];
+		L->occupied[r] &= ~L->marks[r];
+		if (anyset(&L->marks[r]))
+			low = r;
+	}
+
+	/* a block above a hole goes down one row a sweep; going up from
+	   the bottom, each one moves at most once, and nothing below the
+	   lowest hole moves at all */
+	do
+	{
+		moved = L->mask & 0;
+		for (r = low - 1; r >= top; r--)
+		{
+			lanevec_t m = L->occupied[r] & ~L->occupied[r+1];
+
+			for (t = 0; t < BLOCKTYPES; t++)
+			{
+				lanevec_t x = L->planes[t][r] & m;
+
+				L->planes[t][r]   ^= x;
+				L->planes[t][r+1] |= x;
+			}
+			L->occupied[r]   ^= m;
+			L->occupied[r+1] |= m;
+			moved |= m;
+		}
+	} while (anyset(&moved));
+}
+
+/* the same as blocksdestroyed() in game.c */
+static void lanedestroyed(lane_t *l, int num)
+{
+	l->r.score    += num * (l->scorebonus + l->level);
+	l->nextlevel  -= num;
+	l->blockcount -= num;
+	if (l->nextlevel < 0)
+	{
+		l->level++;
+		l->nextlevel = levelblocks(l->level);
+	}
+}
+
+/* the same as startfall() in game.c */
+static void lanefall(lane_t *l)
+{
+	int k;
+
+	if (l->destlevel < l->level
+		&& l->nextlevel >= DESTROYER_BLOCK_WINSTART
+		&& l->nextlevel < DESTROYER_BLOCK_WINEND
+		&& l->level >= DESTROYER_BLOCK_MINLEVEL
+		&& l->blockcount > DESTROYER_BLOCK_MINCOUNT
+		&& lanerandom(&l->rng)%DESTROYER_BLOCK_CHANCE == 0)
+	{
+		l->piece[0] = l->piece[1] = l->piece[2] = 0;
+		l->destlevel = l->level;
+	}
+	else
+	{
+		for (k = 0; k < 3; k++)
+			l->piece[k] = 1 + (int)(lanerandom(&l->rng)%NUMBLOCKS);
+	}
+
+	l->blockcount += 3;
+	l->r.pieces++;
+}
+
+/* start game index in lane i, or leave it empty if index is past the
+   last one; the same as startgame() */
+static void startlane(lanes_t *L, int i, long index, long end)
+{
+	lane_t *l = &L->lane[i];
+	int r, t;
+
+	for (r = 0; r < L->height; r++)
+	{
+		for (t = 0; t < BLOCKTYPES; t++)
+			L->planes[t][r][i] = 0;
+		L->occupied[r][i] = 0;
+	}
+
+	(void)memset(l, 0, sizeof *l);
+	if (index >= end)
+		return;
+
+	l->playing    = 1;
+	l->r.index    = index;
+	l->rng        = laneseed(L->seed + (unsigned long)index);
+	l->policy     = (uint64_t)index * 2 + 1;
+	l->blockcount = 1;
+	l->nextlevel  = levelblocks(0);
+	lanedestroyed(l, 1);
+	lanefall(l);
+}
+
+/* pick a move for lane i's 1x3 block as randompolicy() does, and steer
+   it there; nothing is in the hidden rows, so only the walls can stop
+   it */
+static void steer(lanes_t *L, int i)
+{
+	lane_t *l = &L->lane[i];
+	int shuffles, tmp;
+
+	l->col = (int)(lanerandom(&l->policy) % (unsigned long)L->width);
+	shuffles = (int)(lanerandom(&l->policy) % 3);
+	while (shuffles-- > 0)
+	{
+		tmp = l->piece[2];
+		l->piece[2] = l->piece[1];
+		l->piece[1] = l->piece[0];
+		l->piece[0] = tmp;
+	}
+	L->column[i] = (uint16_t)(1 << l->col);
+}
+
+/* put lane i's 1x3 block where it landed; return 0 if that is game
+   over */
+static int land(lanes_t *L, int i)
+{
+	lane_t *l = &L->lane[i];
+	int bottom = L->bottom[i];
+	uint16_t bit = L->column[i];
+	int k, t;
+
+	/* a tick for each row it fell from the top, and the one it lands
+	   on */
+	l->r.ticks += bottom - 2 + 1;
+	l->scorebonus = 0;
+	l->chain = 0;
+	if (bottom - 2 < HIDDEN_ROWS)
+		return 0;
+
+	for (k = 0; k < 3; k++)
+	{
+		L->planes[l->piece[k]][bottom - 2 + k][i] |= bit;
+		L->occupied[bottom - 2 + k][i] |= bit;
+	}
+
+	l->special = -1;
+	if (l->piece[2] == 0 && bottom + 1 < L->height)
+	{
+		for (t = 0; t < BLOCKTYPES; t++)
+		{
+			if (L->planes[t][bottom + 1][i] & bit)
+				l->special = t;
+		}
+	}
+	return 1;
+}
+
+/* lane i's 1x3 block has been played out; count it, and if the game
+   is over, hand it in and start the next one */
+static void endmove(lanes_t *L, int i)
+{
+	lane_t *l = &L->lane[i];
+
+	l->r.chains[l->lastchain < LANE_CHAINS
+		? l->lastchain : LANE_CHAINS - 1]++;
+	if (l->r.over || l->r.ticks >= L->maxticks)
+	{
+		l->r.level = l->level;
+		L->done(&l->r, L->arg);
+		startlane(L, i, L->next < L->end ? L->next++ : L->end, L->end);
+	}
+}
+
+/* one step of every game: drop the next 1x3 block, or play the next
+   round of the chain reaction the last one set off; return how many
+   lanes have games */
+static int step(lanes_t *L)
+{
+	int i, r, any, playing;
+
+	for (i = 0; i < LANES; i++)
+	{
+		if (L->lane[i].playing && !L->lane[i].settling)
+			steer(L, i);
+	}
+	findbottoms(L);
+
+	(void)memset(L->marks, 0, sizeof L->marks);
+	for (i = 0; i < LANES; i++)
+	{
+		lane_t *l = &L->lane[i];
+
+		L->mask[i] = 0;
+		if (l->playing && !l->settling)
+		{
+			if (!land(L, i))
+			{
+				l->r.over = 1;
+				endmove(L, i);
+				continue;
+			}
+			l->settling = 1;
+		}
+		if (!l->settling)
+			continue;
+
+		L->mask[i] = 0xffff;
+		if (l->special >= 0)
+		{
+			for (r = HIDDEN_ROWS; r < L->height; r++)
+				L->marks[r][i] = L->planes[l->special][r][i];
+			l->special = -1;
+		}
+	}
+	findruns(L);
+
+	any = playing = 0;
+	for (i = 0; i < LANES; i++)
+	{
+		lane_t *l = &L->lane[i];
+
+		if (l->settling && L->counts[i] == 0)
+		{
+			l->settling = 0;
+			l->lastchain = l->chain;
+			lanefall(l);
+			endmove(L, i);
+		}
+		else if (l->settling)
+		{
+			/* eight ticks blinking, one falling */
+			l->chain++;
+			l->r.ticks += BLINK_TIMES + 1;
+			lanedestroyed(l, L->counts[i]);
+			l->r.destroyed += L->counts[i];
+			if (l->scorebonus < SCOREBONUS_MAX)
+				l->scorebonus++;
+			any = 1;
+		}
+		playing += l->playing;
+	}
+	if (any)
+		collapse(L);
+
+	return playing;
+}
+
+/*
+	Play games first to first+count-1 as columns-sim does with the
+random policy, w by h, each one from seed+index, calling done with
+each one's result as it finishes (in no particular order). Return 0
+if the playfield is too big for lanes.
+*/
+int playlanes(int w, int h, unsigned long seed, long first, long count,
+	long maxticks, lanedone_t done, void *arg)
+{
+	lanes_t *L;
+	int i;
+
+	if (w > LANE_WIDTH || h > MAX_HEIGHT)
+		return 0;
+	/* malloc() only lines things up for the widest scalar */
+	if ((L = aligned_alloc(sizeof L->mask, sizeof *L)) == NULL)
+		return 0;
+	(void)memset(L, 0, sizeof *L);
+	L->width    = w;
+	L->height   = h + HIDDEN_ROWS;
+	L->seed     = seed;
+	L->maxticks = maxticks;
+	L->next     = first;
+	L->end      = first + count;
+	L->done     = done;
+	L->arg      = arg;
+
+	for (i = 0; i < LANES; i++)
+		startlane(L, i, L->next < L->end ? L->next++ : L->end, L->end);
+	while (step(L) > 0)
+		;
+
+	free(L);
+	return 1;
+}
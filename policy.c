@@ -0,0 +1,377 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+policy.c: computer players
+*/
+
+#include "game.h"
+#include "pool.h"
+
+/*
+	A policy looks at a game with a 1x3 block just starting to fall
+and decides where it should go: which column, and how many times to
+shuffle it on the way. playmove() then does that through gameinput(),
+exactly as a player could, and runs the game until the next 1x3 block
+appears, so a whole game is just
+
+	while (g->state != STATE_GAMEOVER)
+	{
+		policy(g, &rng, &m);
+		playmove(g, &m);
+	}
+*/
+
+static uint64_t policyrandom(uint64_t *rng)
+{
+	*rng ^= *rng >> 12;
+	*rng ^= *rng << 25;
+	*rng ^= *rng >> 27;
+	return (*rng * 2685821657736338717ULL) >> 33;
+}
+
+/* steer the falling blocks as m says and drop them, then play out
+   what follows (as gametick() would with quickgravity) until the next
+   1x3 block appears or the game is over */
+void playmove(game_t *g, const move_t *m)
+{
+	int i;
+
+	for (i = 0; i < m->shuffles; i++)
+		(void)gameinput(g, INPUT_SHUFFLE);
+	while (g->fallcol < m->col && gameinput(g, INPUT_RIGHT))
+		;
+	while (g->fallcol > m->col && gameinput(g, INPUT_LEFT))
+		;
+	(void)resolvefall(g, NULL);
+}
+
+/* anywhere at all */
+static void randompolicy(const game_t *g, uint64_t *rng, move_t *m)
+{
+	m->col = (int)(policyrandom(rng) % (uint64_t)g->width);
+	m->shuffles = (int)(policyrandom(rng) % 3);
+}
+
+/* how tall the stack is: the sum and the largest of the column
+   heights */
+static void measurestack(const game_t *g, int *sum, int *max)
+{
+	int c;
+
+	*sum = 0;
+	*max = 0;
+	for (c = 0; c < g->width; c++)
+	{
+		int h = stackheight(g, c);
+
+		*sum += h;
+		if (h > *max)
+			*max = h;
+	}
+}
+
+/* the move that scores the most points right away, and otherwise
+   keeps the stack lowest */
+static void greedypolicy(const game_t *g, uint64_t *rng, move_t *m)
+{
+	game_t *try;
+	long best = LONG_MIN;
+	move_t mv;
+
+	(void)rng;
+	m->col = g->fallcol;
+	m->shuffles = 0;
+	if ((try = dupgame(g)) == NULL)
+		return;
+
+	for (mv.col = 0; mv.col < g->width; mv.col++)
+	for (mv.shuffles = 0; mv.shuffles < 3; mv.shuffles++)
+	{
+		int sum, max;
+		long value;
+
+		copygame(try, g);
+		try->quickgravity = 1;
+		playmove(try, &mv);
+		if (try->state == STATE_GAMEOVER)
+			continue;
+
+		measurestack(try, &sum, &max);
+		value = 4L * (try->score - g->score) - sum - 2L * max;
+		if (value > best)
+		{
+			best = value;
+			*m = mv;
+		}
+	}
+	free(try);
+}
+
+/*
+	The lookahead player tries every column and every shuffle for the
+falling block, and for each of those every move for the block after
+it, and so on, depth blocks deep. It knows no more than a player
+would: the falling block, but not the ones after it. So a move that
+lets another block fall is tried LOOKAHEAD_SAMPLES times, each time
+with the game's random number generator set to a made-up state, so
+that the next block is one the game could have sent (a %%% block
+included), and the move is worth the average. The made-up states come
+from the position and a salt taken from the policy's own random state
+once per decision, so every move from a position is tried against the
+same blocks, whichever thread tries it. A position is worth the points
+scored getting there, plus a bonus for chain reactions, less how tall
+the stack is.
+
+	The same position turns up over and over: a block pushed at a
+column it can't get to ends up where it would have anyway, shuffling
+three blocks of one type changes nothing, and two blocks dropped in
+either order can leave the same playfield. So every position searched
+goes in a transposition table, keyed by the playfield's Zobrist hash
+(game_t.hash) mixed with everything else that decides what happens
+next. The table is shared by all threads without locks: each entry is
+two words, the key XORed with the value and the value, and one that two
+threads wrote at once just won't match any key.
+*/
+
+#define TT_BITS 18
+#define TT_SIZE ((size_t)1 << TT_BITS)
+
+#define LOSS         -1000000L /* what ending the game is worth */
+#define SCORE_WEIGHT 4
+#define CHAIN_WEIGHT 8
+#define MAX_MOVES    (MAX_WIDTH * 3)
+
+#define LOOKAHEAD_SAMPLES 4 /* next blocks tried after each move */
+
+typedef struct
+{
+	uint64_t check; /* key ^ data */
+	uint64_t data;  /* the value, as a uint32_t */
+} ttentry_t;
+
+static ttentry_t table[TT_SIZE];
+
+/* g's position, searched depth blocks deep with the made-up blocks
+   salt gives; g->rng isn't part of it, since the search doesn't
+   really know it */
+static uint64_t positionkey(const game_t *g, int depth, uint64_t salt)
+{
+	uint64_t z = salt
+		^ (uint64_t)(unsigned)g->nextlevel << 24
+		^ (uint64_t)(unsigned)g->level << 40
+		^ (uint64_t)(unsigned)g->destlevel << 48
+		^ (uint64_t)(unsigned)depth << 56;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return g->hash ^ z ^ (z >> 31);
+}
+
+static int ttget(uint64_t key, long *value)
+{
+	ttentry_t *e = &table[key & (TT_SIZE - 1)];
+	uint64_t check = __atomic_load_n(&e->check, __ATOMIC_RELAXED);
+	uint64_t data  = __atomic_load_n(&e->data,  __ATOMIC_RELAXED);
+
+	if ((check ^ data) != key)
+		return 0;
+	*value = (int32_t)(uint32_t)data;
+	return 1;
+}
+
+static void ttput(uint64_t key, long value)
+{
+	ttentry_t *e = &table[key & (TT_SIZE - 1)];
+	uint64_t data = (uint32_t)(int32_t)value;
+
+	__atomic_store_n(&e->check, key ^ data, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->data,  data,       __ATOMIC_RELAXED);
+}
+
+/* what the position left in g is worth, without looking further */
+static long stackvalue(const game_t *g)
+{
+	int sum, max;
+
+	measurestack(g, &sum, &max);
+	return -sum - 2L * max;
+}
+
+/* a made-up state for the game's random number generator, the n'th
+   for the position with key node */
+static uint64_t samplerng(uint64_t node, int n)
+{
+	uint64_t z = node + (uint64_t)(n + 1) * 0x9e3779b97f4a7c15ULL;
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z ^= z >> 31;
+	return z != 0 ? z : 1;
+}
+
+static long search(const game_t *g, int depth, uint64_t salt, move_t *m);
+
+/* what making move mv in g is worth, looking depth blocks ahead
+   (including this one), on average over the blocks that could come
+   next; the move is made on a copy of g, which is quicker than taking
+   it back (see tryout-undo and tryout-copy in columns-bench) */
+static long movevalue(const game_t *g, const move_t *mv, int depth,
+	uint64_t salt)
+{
+	game_t *try;
+	long value = 0, rest;
+	uint64_t node = 0, key;
+	int samples = depth <= 1 ? 1 : LOOKAHEAD_SAMPLES;
+	int i;
+
+	if ((try = dupgame(g)) == NULL)
+		return LOSS - 1;
+	if (samples > 1)
+		node = positionkey(g, depth, salt);
+
+	for (i = 0; i < samples; i++)
+	{
+		if (i > 0)
+			copygame(try, g);
+		try->quickgravity = 1;
+		if (samples > 1)
+			try->rng = samplerng(node, i);
+		playmove(try, mv);
+
+		/* the blocks to come have nothing to do with this */
+		if (try->state == STATE_GAMEOVER)
+		{
+			free(try);
+			return LOSS;
+		}
+
+		value += SCORE_WEIGHT * (long)(try->score - g->score)
+			+ CHAIN_WEIGHT * (long)try->lastchain * try->lastchain;
+		if (depth <= 1)
+			value += stackvalue(try);
+		else
+		{
+			key = positionkey(try, depth - 1, salt);
+			if (!ttget(key, &rest))
+			{
+				rest = search(try, depth - 1, salt, NULL);
+				ttput(key, rest);
+			}
+			value += rest;
+		}
+	}
+
+	free(try);
+	return value / samples;
+}
+
+/* the best any move for g's falling block can do, looking depth
+   blocks ahead; the move goes in m, if it's not NULL */
+static long search(const game_t *g, int depth, uint64_t salt, move_t *m)
+{
+	long best = LOSS - 1;
+	move_t mv;
+
+	for (mv.col = 0; mv.col < g->width; mv.col++)
+	for (mv.shuffles = 0; mv.shuffles < 3; mv.shuffles++)
+	{
+		long value = movevalue(g, &mv, depth, salt);
+
+		if (value > best)
+		{
+			best = value;
+			if (m != NULL)
+				*m = mv;
+		}
+	}
+	return best;
+}
+
+/* with more than one thread, each move for the falling block is a task
+   of its own */
+typedef struct
+{
+	const game_t *g;
+	int depth;
+	uint64_t salt;
+	long values[MAX_MOVES];
+} root_t;
+
+static void rootmove(long index, int worker, void *arg)
+{
+	root_t *root = arg;
+	move_t mv;
+
+	(void)worker;
+	mv.col = (int)(index / 3);
+	mv.shuffles = (int)(index % 3);
+	root->values[index] = movevalue(root->g, &mv, root->depth,
+		root->salt);
+}
+
+/* decide where the block that has just started falling in g should
+   go, looking depth blocks ahead and using up to threads threads; rng
+   is random state of the caller's, for making up the blocks after it */
+void lookahead(const game_t *g, int depth, int threads, uint64_t *rng,
+	move_t *m)
+{
+	root_t root;
+	long best = LOSS - 1;
+	int i, n = g->width * 3;
+
+	m->col = g->fallcol;
+	m->shuffles = 0;
+
+	root.g = g;
+	root.depth = depth;
+	root.salt = policyrandom(rng) << 32 ^ policyrandom(rng);
+	if (threads > n)
+		threads = n;
+	if (threads > 1)
+		(void)runpool(n, threads, rootmove, &root);
+	else
+	{
+		for (i = 0; i < n; i++)
+			rootmove(i, 0, &root);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (root.values[i] > best)
+		{
+			best = root.values[i];
+			m->col = i / 3;
+			m->shuffles = i % 3;
+		}
+	}
+}
+
+/* two blocks ahead, on one thread */
+static void lookaheadpolicy(const game_t *g, uint64_t *rng, move_t *m)
+{
+	lookahead(g, LOOKAHEAD_DEPTH, 1, rng, m);
+}
+
+static const struct
+{
+	const char *name;
+	policy_t policy;
+} policies[] =
+{
+	{ "random",    randompolicy },
+	{ "greedy",    greedypolicy },
+	{ "lookahead", lookaheadpolicy }
+};
+
+/* the policy called name, or NULL if there's no such thing */
+policy_t findpolicy(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof policies / sizeof policies[0]; i++)
+	{
+		if (strcmp(name, policies[i].name) == 0)
+			return policies[i].policy;
+	}
+	return NULL;
+}
@@ -0,0 +1,176 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+pool.c: running lots of independent tasks on all the processors
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/*
+	The tasks are numbered 0 to count-1 and start out split evenly
+between the workers. Each worker keeps the indexes it still has to run
+as a range and takes them from the bottom. A worker that runs out
+steals the top half of some other worker's range, so when some tasks
+take much longer than others (like games that last longer) nobody sits
+idle while there's still work.
+
+	Nothing new gets added once the pool is running, so a worker that
+finds every range empty can stop.
+*/
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	long lo, hi;    /* indexes not started yet: lo to hi-1 */
+	char pad[64];   /* keep each worker's range in its own cache line */
+} range_t;
+
+typedef struct
+{
+	int workers;
+	range_t ranges[MAX_WORKERS];
+	pooltask_t task;
+	void *arg;
+} pool_t;
+
+typedef struct
+{
+	pool_t *pool;
+	int id;
+} worker_t;
+
+int numprocessors(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1)
+		return 1;
+	if (n > MAX_WORKERS)
+		return MAX_WORKERS;
+	return (int)n;
+}
+
+/* take the next index from r; return 0 if it's empty */
+static int take(range_t *r, long *index)
+{
+	int got = 0;
+
+	(void)pthread_mutex_lock(&r->lock);
+	if (r->lo < r->hi)
+	{
+		*index = r->lo++;
+		got = 1;
+	}
+	(void)pthread_mutex_unlock(&r->lock);
+	return got;
+}
+
+/* move half of some other worker's range into worker id's range;
+   return 0 if there's nothing left anywhere */
+static int steal(pool_t *p, int id)
+{
+	int i;
+
+	for (i = 1; i < p->workers; i++)
+	{
+		range_t *victim = &p->ranges[(id + i) % p->workers];
+		long lo = 0, hi = 0;
+
+		(void)pthread_mutex_lock(&victim->lock);
+		if (victim->lo < victim->hi)
+		{
+			hi = victim->hi;
+			lo = hi - (victim->hi - victim->lo + 1) / 2;
+			victim->hi = lo;
+		}
+		(void)pthread_mutex_unlock(&victim->lock);
+
+		if (lo < hi)
+		{
+			range_t *mine = &p->ranges[id];
+
+			(void)pthread_mutex_lock(&mine->lock);
+			mine->lo = lo;
+			mine->hi = hi;
+			(void)pthread_mutex_unlock(&mine->lock);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void *work(void *arg)
+{
+	worker_t *w = arg;
+	pool_t *p = w->pool;
+	long index;
+
+	do
+	{
+		while (take(&p->ranges[w->id], &index))
+			p->task(index, w->id, p->arg);
+	} while (steal(p, w->id));
+
+	return NULL;
+}
+
+/* call task for every index from 0 to count-1, using up to that many
+   workers (threads), and return when they're all done; return how many
+   workers there were, the caller included */
+int runpool(long count, int workers, pooltask_t task, void *arg)
+{
+	pool_t *p;
+	pthread_t threads[MAX_WORKERS];
+	worker_t ws[MAX_WORKERS];
+	long index;
+	int i, started;
+
+	if (workers < 1)
+		workers = 1;
+	if (workers > MAX_WORKERS)
+		workers = MAX_WORKERS;
+	if (workers > count) /* there'd be nothing for the rest to do */
+		workers = count > 1 ? (int)count : 1;
+
+	if (workers == 1 || (p = malloc(sizeof *p)) == NULL)
+	{
+		for (index = 0; index < count; index++)
+			task(index, 0, arg);
+		return 1;
+	}
+
+	p->workers = workers;
+	p->task = task;
+	p->arg = arg;
+
+	for (i = 0; i < workers; i++)
+	{
+		(void)pthread_mutex_init(&p->ranges[i].lock, NULL);
+		p->ranges[i].lo = count * i / workers;
+		p->ranges[i].hi = count * (i + 1) / workers;
+		ws[i].pool = p;
+		ws[i].id = i;
+	}
+
+	/* worker 0 is this thread */
+	for (i = 1; i < workers; i++)
+	{
+		if (pthread_create(&threads[i], NULL, work, &ws[i]) != 0)
+			break;
+	}
+	(void)work(&ws[0]);
+
+	/* any threads that didn't start had their work stolen by now */
+	started = i;
+	while (--i > 0)
+		(void)pthread_join(threads[i], NULL);
+
+	for (i = 0; i < workers; i++)
+		(void)pthread_mutex_destroy(&p->ranges[i].lock);
+	free(p);
+	return started;
+}
@@ -0,0 +1,19 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+pool.h: running lots of independent tasks on all the processors
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+/* a task is called once for each index; worker is which thread (0 to
+   workers-1) is running it, for keeping per-thread results */
+typedef void (*pooltask_t)(long index, int worker, void *arg);
+
+#define MAX_WORKERS 256
+
+int numprocessors(void);
+int runpool(long count, int workers, pooltask_t task, void *arg);
+
+#endif
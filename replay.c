@@ -0,0 +1,149 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+replay.c: recording games and playing them back
+*/
+
+#include "columns.h"
+
+/*
+	A replay is a text file. The first lines give the seed and the
+size of the playfield, which is everything needed to start the same
+game again; after that comes one line per input, saying on which tick
+(see gametick()) it happened and what it was:
+
+	columns replay 1
+	seed 1234
+	size 10 15
+	0 left
+	0 left
+	7 shuffle
+	...
+	412 quit
+
+Inputs are applied in the order they appear, before the tick they are
+stamped with.
+*/
+
+#define REPLAY_MAGIC "columns replay 1"
+
+static const char *inputnames[] =
+{
+	"left",     /* INPUT_LEFT */
+	"right",    /* INPUT_RIGHT */
+	"shuffle",  /* INPUT_SHUFFLE */
+	"down"      /* INPUT_DOWN */
+};
+
+#define NUMINPUTS ((int)(sizeof inputnames / sizeof inputnames[0]))
+
+static FILE *recfile = NULL;
+static FILE *playfile = NULL; /* closed once the last input is read */
+static int playing = 0;       /* a replay is being played back */
+
+static long nexttick = -1; /* tick of the next input in playfile */
+static int nextinput = -1; /* and what it is, or -1 to quit */
+
+/* start recording a game to file; return 0 if that can't be done */
+int recordreplay(const char *file, unsigned long seed, int w, int h)
+{
+	if ((recfile = fopen(file, "w")) == NULL)
+		return 0;
+
+	(void)fprintf(recfile, "%s\nseed %lu\nsize %d %d\n",
+		REPLAY_MAGIC, seed, w, h);
+	return 1;
+}
+
+void recordinput(long tick, gameinput_t in)
+{
+	if (recfile != NULL)
+		(void)fprintf(recfile, "%ld %s\n", tick, inputnames[in]);
+}
+
+/* the game is over (or the player quit) at tick; stop recording */
+void recordend(long tick)
+{
+	if (recfile == NULL)
+		return;
+
+	(void)fprintf(recfile, "%ld quit\n", tick);
+	(void)fclose(recfile);
+	recfile = NULL;
+}
+
+/* the game is over, or the replay has nothing more in it; stop
+   reading it */
+void playend(void)
+{
+	if (playfile == NULL)
+		return;
+
+	(void)fclose(playfile);
+	playfile = NULL;
+}
+
+/* read the next input line from playfile into nexttick/nextinput */
+static void readnext(void)
+{
+	char name[32];
+	int i;
+
+	nexttick = -1;
+	nextinput = -1;
+
+	if (fscanf(playfile, "%ld %31s", &nexttick, name) != 2)
+	{
+		playend(); /* treat the end of the file like a quit */
+		return;
+	}
+
+	for (i = 0; i < NUMINPUTS; i++)
+	{
+		if (strcmp(name, inputnames[i]) == 0)
+		{
+			nextinput = i;
+			return;
+		}
+	}
+	playend(); /* a quit; nothing after it matters */
+}
+
+/* open a replay for playback, getting the game's seed and size;
+   return 0 if it isn't a replay */
+int loadreplay(const char *file, unsigned long *seed, int *w, int *h)
+{
+	char magic[sizeof REPLAY_MAGIC + 1];
+
+	if ((playfile = fopen(file, "r")) == NULL)
+		return 0;
+
+	if (fgets(magic, (int)sizeof magic, playfile) == NULL
+		|| strncmp(magic, REPLAY_MAGIC, strlen(REPLAY_MAGIC)) != 0
+		|| fscanf(playfile, " seed %lu size %d %d", seed, w, h) != 3)
+	{
+		(void)fclose(playfile);
+		playfile = NULL;
+		return 0;
+	}
+
+	playing = 1;
+	readnext();
+	return 1;
+}
+
+/* apply to g every input recorded for its current tick; return 1 if
+   the recording ends here */
+int playreplay(game_t *g)
+{
+	if (!playing)
+		return 0;
+
+	while (nexttick >= 0 && nexttick <= g->ticks && nextinput >= 0)
+	{
+		(void)gameinput(g, (gameinput_t)nextinput);
+		readnext();
+	}
+
+	return nexttick < 0 || (nexttick <= g->ticks && nextinput < 0);
+}
@@ -0,0 +1,79 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+sched.c: keeping the game going at a steady speed
+*/
+
+#include "columns.h"
+
+/*
+	Every tick has a time it's due, on the monotonic clock (which
+doesn't jump when someone sets the date), and the next one is due
+tickdelay() after that, no matter when this one actually ran. So time
+spent drawing, or waiting for a busy machine to get around to us, is
+taken out of the wait for the next tick instead of being added to it,
+and if ticks were missed they are run back to back until the game is
+on schedule again.
+
+	When a tick is more than MAX_LATENESS late (the game was paused,
+or the process was stopped), catching up would just make the blocks
+race down the screen, so the schedule starts over from now instead.
+*/
+
+#define MAX_LATENESS 1000000000LL /* ns */
+
+/* nanoseconds on the monotonic clock */
+long long monotime(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* the first tick is due ms from now */
+void schedstart(sched_t *s, int ms)
+{
+	(void)memset(s, 0, sizeof *s);
+	s->due = monotime() + ms * 1000000LL;
+}
+
+/* a tick is about to run; keep track of how late it is */
+void schedtick(sched_t *s)
+{
+	long long late = monotime() - s->due;
+
+	if (late > MAX_LATENESS)
+	{
+		s->resyncs++;
+		s->due += late;
+		late = 0;
+	}
+	if (late < 0)
+		late = 0;
+
+	s->ticks++;
+	s->lateness += late;
+	if (late > s->worst)
+		s->worst = late;
+}
+
+/* the next tick is due ms after the last one was */
+void schednext(sched_t *s, int ms)
+{
+	s->due += ms * 1000000LL;
+	if (schedbehind(s))
+		s->caughtup++;
+}
+
+/* is the next tick due already? */
+int schedbehind(const sched_t *s)
+{
+	return monotime() >= s->due;
+}
+
+/* the game was stopped for a while; the next tick is due ms from now */
+void schedresume(sched_t *s, int ms)
+{
+	s->resyncs++;
+	s->due = monotime() + ms * 1000000LL;
+}
@@ -6,21 +6,142 @@ screen.c: drawing
 
 #include "columns.h"
 
+#include <pthread.h>
+
 #define DOUBLEWIDTH
 
+static int ansi = 0; /* draw with ansi.c instead of curses */
+
 static int drawwidth;
 static int drawheight;
 
 static int drawleft;
 static int drawtop;
 
+/*
+	When the playfield is bigger than the terminal, only a view of it
+is drawn, as much as fits, and the view moves to keep the falling
+blocks in it: when they go out of it, it jumps to put them in the
+middle, and everything in it is drawn again.
+*/
+static int boardwidth;   /* the whole playfield's size */
+static int boardheight;
+static int viewwidth;    /* the view's */
+static int viewheight;
+static int viewleft = 0; /* the playfield column and visible row at */
+static int viewtop = 0;  /* the view's top left */
+static int viewmoved = 1;
+
+/* the terminal (and curses, which isn't thread safe) is only drawn on
+   with this held; keys are read without it (see readkey()) */
+static pthread_mutex_t screenlock = PTHREAD_MUTEX_INITIALIZER;
+static int borders = 0; /* drawborders() calls so far */
+
+/* get the terminal ready for the game; with useansi, use escape
+   sequences of our own instead of curses */
+void startscreen(int useansi)
+{
+	ansi = useansi;
+	if (ansi)
+	{
+		if (!ansistart(STDIN_FILENO, STDOUT_FILENO))
+			ansi = 0;
+		else
+			return;
+	}
+
+	(void)initscr();
+	(void)keypad(stdscr, TRUE);
+	(void)nonl();
+	(void)noecho();
+	(void)cbreak();
+	(void)nodelay(stdscr, TRUE);
+	(void)curs_set(0); /* invisible cursor */
+	ansikeys(STDIN_FILENO);
+}
+
+/* draw with escape sequences to ofd, without reading any keys; for
+   timing the drawing */
+void benchscreen(int ofd)
+{
+	ansi = ansistart(-1, ofd);
+}
+
+/* put the terminal back the way it was */
+void endscreen(void)
+{
+	if (ansi)
+	{
+		ansiend();
+		return;
+	}
+
+	(void)curs_set(1); /* visible */
+	(void)endwin();
+}
+
+/* the terminal is now rows by cols */
+void resizescreen(int rows, int cols)
+{
+	(void)pthread_mutex_lock(&screenlock);
+	if (ansi)
+		ansiresize(rows, cols);
+	else
+		(void)resizeterm(rows, cols);
+	(void)pthread_mutex_unlock(&screenlock);
+}
+
+static int screenlines(void)
+{
+	return ansi ? ansirows() : LINES;
+}
+
+static int screencols(void)
+{
+	return ansi ? ansicols() : COLS;
+}
+
+/* the next key pressed, or ERR if there isn't one. Keys are always
+   read by ansi.c, straight from stdin: getch() would have to wait for
+   screenlock while the render thread sends a frame, and would refresh
+   the screen itself. */
+int readkey(void)
+{
+	return ansikey();
+}
+
+/* how many ms until readkey() should be called again, for a key it
+   has only read part of, or -1 for whenever more comes in */
+int readkeywait(void)
+{
+	return ansikeywait();
+}
+
+static void putat(int row, int col, chtype ch)
+{
+	if (ansi)
+		ansiput(row, col, (char)ch);
+	else
+		(void)mvaddch(row, col, ch);
+}
+
+static void putstrat(int row, int col, const char *s)
+{
+	if (ansi)
+	{
+		while (*s != '\0')
+			ansiput(row, col++, *s++);
+	}
+	else
+		(void)mvaddstr(row, col, s);
+}
+
 static void drawhorizline(int row, int colstart, int colend)
 {
 	int i;
 
-	(void)move(row, colstart);
 	for (i = colstart; i <= colend; i++)
-		(void)addch('-');
+		putat(row, i, '-');
 }
 
 static void drawvertline(int rowstart, int rowend, int col)
@@ -28,36 +149,64 @@ static void drawvertline(int rowstart, int rowend, int col)
 	int i;
 
 	for (i = rowstart; i <= rowend; i++)
-		(void)mvaddch(i, col, '|');
+		putat(i, col, '|');
 }
 
+/* is there room for a view of a width by height playfield, or of at
+   least MIN_WIDTH by MIN_HEIGHT of it? */
 int playsizeok(int width, int height)
 {
+	if (width > MIN_WIDTH)
+		width = MIN_WIDTH;
+	if (height > MIN_HEIGHT)
+		height = MIN_HEIGHT;
 #ifdef DOUBLEWIDTH
 	width *= 2;
 #endif
-	if (width + (2+PANEL_WIDTH)*2 > COLS)
+	if (width + (2+PANEL_WIDTH)*2 > screencols())
 		return 0;
-	if (height + 2 > LINES)
+	if (height + 2 > screenlines())
 		return 0;
 	return 1;
 }
 
 void drawborders(int width, int height)
 {
-	drawwidth  = width;
-	drawheight = height;
+	int cols;
+
+	(void)pthread_mutex_lock(&screenlock);
+	borders++;
+	cols = (screencols() - (2+PANEL_WIDTH)*2);
+
+#ifdef DOUBLEWIDTH
+	cols /= 2;
+#endif
+	boardwidth  = width;
+	boardheight = height;
+	viewwidth   = width < cols ? width : cols;
+	viewheight  = height < screenlines() - 2 ? height : screenlines() - 2;
+	if (viewleft > width - viewwidth)
+		viewleft = width - viewwidth;
+	if (viewtop > height - viewheight)
+		viewtop = height - viewheight;
+	viewmoved   = 1;
+
+	drawwidth  = viewwidth;
+	drawheight = viewheight;
 
 #ifdef DOUBLEWIDTH
 	drawwidth  *= 2;
 #endif
 
 	/* center the playfield */
-	drawleft = (COLS  - drawwidth)  / 2;
-	drawtop  = (LINES - drawheight) / 2;
+	drawleft = (screencols()  - drawwidth)  / 2;
+	drawtop  = (screenlines() - drawheight) / 2;
 
 	/* clear the screen */
-	(void)erase();
+	if (ansi)
+		ansiclear();
+	else
+		(void)erase();
 
 	/* draw the horizontal borders */
 	drawhorizline(drawtop - 1,          drawleft, drawleft + drawwidth - 1);
@@ -66,6 +215,7 @@ void drawborders(int width, int height)
 	/* draw the vertical borders */
 	drawvertline(drawtop, drawtop + drawheight - 1, drawleft - 1);
 	drawvertline(drawtop, drawtop + drawheight - 1, drawleft + drawwidth);
+	(void)pthread_mutex_unlock(&screenlock);
 }
 
 void drawblock(int row, int col, chtype ch)
@@ -73,9 +223,9 @@ void drawblock(int row, int col, chtype ch)
 #ifdef DOUBLEWIDTH
 	col *= 2;
 #endif
-	(void)mvaddch(row + drawtop, col + drawleft, ch);
+	putat(row + drawtop, col + drawleft, ch);
 #ifdef DOUBLEWIDTH
-	(void)addch(ch);
+	putat(row + drawtop, col + drawleft + 1, ch);
 #endif
 }
 
@@ -89,7 +239,7 @@ void drawlevel(int level)
 	startcol = drawleft + drawwidth + 2;
 	startcol += (PANEL_WIDTH - (int)strlen(buf)) / 2;
 
-	(void)mvaddstr(drawtop + 1, startcol, buf);
+	putstrat(drawtop + 1, startcol, buf);
 }
 
 void drawscore(int score)
@@ -102,10 +252,548 @@ void drawscore(int score)
 	startcol = drawleft - 2 - PANEL_WIDTH;
 	startcol += (PANEL_WIDTH - (int)strlen(buf)) / 2;
 
-	(void)mvaddstr(drawtop + 1, startcol, buf);
+	putstrat(drawtop + 1, startcol, buf);
+}
+
+/* a line of the panel under the level, for drawstats() */
+void drawpanelline(int line, const char *s)
+{
+	putstrat(drawtop + 3 + line, drawleft + drawwidth + 2, s);
+}
+
+/* where the view should start for a thing at pos (of size 1 to 3) to
+   be in the middle of it */
+static int centre(int pos, int size, int view, int board)
+{
+	pos -= (view - size) / 2;
+	if (pos > board - view)
+		pos = board - view;
+	return pos > 0 ? pos : 0;
+}
+
+/* move the view if the falling blocks have gone out of it */
+static void followblocks(const game_t *g)
+{
+	int row = g->fallrow - HIDDEN_ROWS;
+
+	if (g->state != STATE_FALL)
+		return;
+	if (row < 0)
+		row = 0;
+
+	if (g->fallcol < viewleft || g->fallcol >= viewleft + viewwidth)
+	{
+		viewleft = centre(g->fallcol, 1, viewwidth, boardwidth);
+		viewmoved = 1;
+	}
+	if (row < viewtop || row + 3 > viewtop + viewheight)
+	{
+		viewtop = centre(row, 3, viewheight, boardheight);
+		viewmoved = 1;
+	}
+}
+
+/*
+	Drawing happens on a thread of its own, so that a terminal slow to
+take what's sent to it (curses blocking in refresh() on a congested
+SSH link) holds up only the drawing, never the game. drawscreen() runs
+on the game's thread and doesn't draw anything: it brings its own copy
+of what's in view up to date, from the cells takechanges() says have
+changed, and publishes a frame with that, the score and the level. The
+render thread draws the latest frame published, whatever it missed in
+between, and only the cells that differ from the last one it drew.
+
+	Frames go through three slots with no locking: the game thread
+fills one, the render thread draws from another, and the third is the
+latest one published, swapped with the game thread's when it publishes
+and with the render thread's when that takes it. Which slot is which
+is one int, changed with atomic exchanges; the FRESH bit in it says the
+render thread hasn't taken the latest frame yet. A frame replaced while
+it still had that bit was never drawn.
+*/
+
+#define FRESH 4
+
+#define STATS_EVERY 500000000LL /* ns between -i's panel updates */
+
+typedef struct
+{
+	int borders;       /* the drawborders() it was made after */
+	int width;         /* the view's size */
+	int height;
+	int score;
+	int level;
+	long long keyseen; /* see framekey() */
+	char *cells;       /* what the view shows, row by row */
+	size_t size;       /* room in cells */
+} frame_t;
+
+static frame_t frames[3];
+static int latest = 0;  /* slot of the frame last published, | FRESH */
+static int filling = 1; /* the game thread's slot */
+static int showing = 2; /* the render thread's slot */
+
+static char *view = NULL;       /* the game thread's copy of the view */
+static size_t viewsize = 0;
+static long long keyseen = 0;
+
+static char *drawn = NULL;      /* what the render thread last drew */
+static size_t drawnsize = 0;
+static int drawnborders = -1;
+
+static pthread_t renderthread;
+static int rendering = 0;       /* the render thread is running */
+static int stopping = 0;        /* and should stop when it's done */
+static int measuring = 0;       /* time every frame, for -i */
+static int wakepipe[2] = { -1, -1 };
+
+/* make sure a buffer holds at least size chars; return 0 if it can't */
+static int makeroom(char **buf, size_t *room, size_t size)
+{
+	char *bigger;
+
+	if (*room >= size)
+		return 1;
+	if ((bigger = realloc(*buf, size)) == NULL)
+		return 0;
+	*buf = bigger;
+	*room = size;
+	return 1;
+}
+
+/* put the frame in the game thread's slot out for drawing */
+static void publish(void)
+{
+	int old = __atomic_exchange_n(&latest, filling | FRESH,
+		__ATOMIC_ACQ_REL);
+
+	filling = old & ~FRESH;
+
+	/* a key the dropped frame showed is shown by the next one */
+	if ((old & FRESH) && keyseen == 0)
+		keyseen = frames[filling].keyseen;
+}
+
+/* the latest frame, if the render thread hasn't had it yet */
+static frame_t *takeframe(void)
+{
+	if (!(__atomic_load_n(&latest, __ATOMIC_ACQUIRE) & FRESH))
+		return NULL;
+	showing = __atomic_exchange_n(&latest, showing, __ATOMIC_ACQ_REL)
+		& ~FRESH;
+	return &frames[showing];
+}
+
+/*
+	When the terminal takes output more slowly than frames come (a
+congested SSH link), drawing every frame as it comes just queues them
+up, and the screen falls further and further behind the game. So the
+render thread works out how fast the terminal takes what it's sent,
+and holds frames back to keep within that. Frames published meanwhile
+replace the one held back, so a burst of moves or a tall cascade turns
+into a frame or two showing how things stand now; since every frame
+carries the whole view, skipping some never leaves the screen wrong. A
+frame is never held back more than MAX_HOLD, and the last one is drawn
+whatever the terminal is doing.
+
+	Where the terminal says how much is still waiting to go to it
+(TIOCOUTQ), a frame waits until that's gone, for about as long as it
+should take at the rate it has been going down. Linux always says 0
+for a pseudo terminal, whose queue is out of sight in whatever reads
+the other end, but a write to one only stops for long (BLOCKED) when
+that's full; and between two such writes, the terminal took just what
+was sent, so that over the time between them is the rate. Frames then
+go at half of it, giving what's queued up a chance to drain, and the
+rate creeps up with every second nothing stops, in case the link has
+got faster.
+*/
+
+#define MAX_HOLD  200000000LL  /* ns */
+#define BLOCKED   20000000LL   /* ns */
+#define MIN_SLEEP 1            /* ms to wait for the terminal, at least */
+#define MAX_SLEEP 50           /* and at most */
+
+static long long drainrate = 0; /* bytes a second, or 0 if unknown */
+static long long nextframe = 0; /* no frame before this (monotime()) */
+static int outqworks = 0;       /* TIOCOUTQ has said something but 0 */
+static long long lastcheck;     /* when the queue was last looked at */
+static int lastqueued = 0;      /* and what was in it then */
+static long long lastfull = 0;  /* when a write last stopped, or 0 */
+static long long lastprobe;     /* when the rate last crept up */
+static long long sincefull = 0; /* bytes sent since lastfull */
+static __thread int iofd = -2;  /* /proc/thread-self/io, for screenbytes() */
+
+/* bytes sent to the terminal that it hasn't taken yet */
+static int outqueue(void)
+{
+	int n;
+
+	if (ioctl(STDOUT_FILENO, TIOCOUTQ, &n) != 0 || n < 0)
+		return 0;
+	if (n > 0)
+		outqworks = 1;
+	return n;
+}
+
+/* the terminal took bytes in ns; if it could have been quicker, say so
+   with atleast */
+static void drained(long long bytes, long long ns, int atleast)
+{
+	long long rate = bytes * 1000000000LL / ns;
+
+	if (atleast)
+		drainrate = rate > drainrate ? rate : drainrate;
+	else
+		drainrate = drainrate == 0 ? rate : (drainrate * 3 + rate) / 4;
+}
+
+/* send what's been drawn to the terminal, and see how quickly it
+   took it */
+static void flushframe(void)
+{
+	long long t0, t, sent;
+
+	if (!rendering)
+	{
+		updatescreen();
+		return;
+	}
+	t0 = monotime();
+	sent = screenbytes();
+	updatescreen();
+	t = monotime();
+	if (sent >= 0)
+		sent = screenbytes() - sent;
+	lastcheck = t;
+	lastqueued = outqueue();
+	if (outqworks || sent <= 0)
+		return;
+
+	if (t - t0 >= BLOCKED)
+	{
+		if (lastfull != 0)
+			drained(sincefull + sent, t - lastfull, 0);
+		lastfull = lastprobe = t;
+		sincefull = 0;
+	}
+	else
+	{
+		sincefull += sent;
+		if (t - lastprobe >= 1000000000LL)
+		{
+			drainrate += drainrate / 16;
+			lastprobe = t;
+		}
+	}
+	if (drainrate > 0)
+		nextframe = t + sent * 2000000000LL / drainrate;
+}
+
+/* how many ms to hold a frame waiting since heldsince back, or 0 to
+   draw it now */
+static int holdoff(long long heldsince)
+{
+	long long now = monotime();
+	int queued = outqueue();
+	long long ms;
+
+	if (now - heldsince >= MAX_HOLD)
+		return 0;
+	if (outqworks)
+	{
+		/* the render thread is the only writer, so anything that
+		   left the queue since it was last looked at drained in
+		   that time */
+		if (queued < lastqueued && now > lastcheck)
+			drained(lastqueued - queued, now - lastcheck,
+				queued == 0);
+		lastcheck = now;
+		lastqueued = queued;
+		if (queued == 0)
+			return 0;
+		ms = drainrate > 0 ? queued * 1000LL / drainrate : MIN_SLEEP;
+	}
+	else if (now < nextframe)
+		ms = (nextframe - now + 999999) / 1000000;
+	else
+		return 0;
+	return ms < MIN_SLEEP ? MIN_SLEEP
+		: ms > MAX_SLEEP ? MAX_SLEEP : (int)ms;
+}
+
+/* draw what's changed between f and the last frame drawn; a frame made
+   before the latest drawborders() is out of date and left alone */
+static void showframe(frame_t *f)
+{
+	static int lastlevel = -2;
+	static int lastscore = -2;
+	static long long lastpanel = 0;
+	long long t0 = 0, bytes = 0;
+	int i, n;
+
+	TRACE_BEGIN("draw");
+	(void)pthread_mutex_lock(&screenlock);
+	if (f->borders != borders)
+	{
+		(void)pthread_mutex_unlock(&screenlock);
+		TRACE_END("draw");
+		return;
+	}
+	if (measuring)
+	{
+		t0 = monotime();
+		bytes = screenbytes();
+	}
+
+	/* drawborders() left the playfield blank */
+	n = f->width * f->height;
+	if (f->borders != drawnborders)
+	{
+		if (!makeroom(&drawn, &drawnsize, (size_t)n + 1))
+		{
+			(void)pthread_mutex_unlock(&screenlock);
+			TRACE_END("draw");
+			return;
+		}
+		(void)memset(drawn, ' ', (size_t)n);
+		drawnborders = f->borders;
+		lastlevel = lastscore = -2;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (f->cells[i] != drawn[i])
+		{
+			drawn[i] = f->cells[i];
+			drawblock(i / f->width, i % f->width, (chtype)drawn[i]);
+		}
+	}
+
+	if (f->score != lastscore)
+	{
+		lastscore = f->score;
+		drawscore(f->score);
+	}
+	if (f->level != lastlevel)
+	{
+		lastlevel = f->level;
+		drawlevel(f->level);
+	}
+
+	if (measuring && t0 - lastpanel >= STATS_EVERY)
+	{
+		lastpanel = t0;
+		drawstats();
+	}
+	flushframe();
+
+	if (measuring)
+	{
+		long long t = monotime();
+
+		statadd(STAT_DRAW, t - t0);
+		if (bytes >= 0)
+			statadd(STAT_BYTES, screenbytes() - bytes);
+		if (f->keyseen != 0)
+			statadd(STAT_LAG, t - f->keyseen);
+	}
+	(void)pthread_mutex_unlock(&screenlock);
+	TRACE_END("draw");
+}
+
+/* the thread is done drawing; it won't need screenbytes() again */
+static void endscreenbytes(void)
+{
+	if (iofd >= 0)
+		(void)close(iofd);
+	iofd = -2;
+}
+
+static void *renderloop(void *arg)
+{
+	struct pollfd pfd;
+	char buf[64];
+	long long heldsince = 0;
+	frame_t *f;
+
+	(void)arg;
+	pfd.fd = wakepipe[0];
+	pfd.events = POLLIN;
+	for (;;)
+	{
+		int stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+		int ms = -1;
+
+		if (__atomic_load_n(&latest, __ATOMIC_ACQUIRE) & FRESH)
+		{
+			if (heldsince == 0)
+				heldsince = monotime();
+			if (stop || (ms = holdoff(heldsince)) == 0)
+			{
+				if (measuring)
+					statadd(STAT_WAIT, monotime() - heldsince);
+				heldsince = 0;
+				if ((f = takeframe()) != NULL)
+					showframe(f);
+				continue;
+			}
+		}
+		else if (stop)
+			break;
+
+		(void)poll(&pfd, 1, ms);
+		while (read(wakepipe[0], buf, sizeof buf) > 0)
+			;
+	}
+	endscreenbytes();
+	return NULL;
+}
+
+/* start drawing on a thread of its own, timing every frame if measure
+   is set; if there can't be one, drawscreen() draws straight away */
+void startrender(int measure)
+{
+	sigset_t all, old;
+
+	measuring = measure;
+	if (rendering || pipe(wakepipe) != 0)
+		return;
+	(void)fcntl(wakepipe[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(wakepipe[1], F_SETFL, O_NONBLOCK);
+
+	/* signals are for the game's thread */
+	(void)sigfillset(&all);
+	(void)pthread_sigmask(SIG_SETMASK, &all, &old);
+	stopping = 0;
+	rendering = pthread_create(&renderthread, NULL, renderloop, NULL)
+		== 0;
+	(void)pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (!rendering)
+	{
+		(void)close(wakepipe[0]);
+		(void)close(wakepipe[1]);
+	}
+}
+
+/* have the render thread draw the last frame published, and stop */
+void stoprender(void)
+{
+	char c = 0;
+
+	if (!rendering)
+		return;
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	(void)write(wakepipe[1], &c, 1);
+	(void)pthread_join(renderthread, NULL);
+	(void)close(wakepipe[0]);
+	(void)close(wakepipe[1]);
+	rendering = 0;
+}
+
+/* the next frame shows what a key seen at seen (monotime()) did; -i
+   measures how long that takes to reach the screen */
+void framekey(long long seen)
+{
+	if (keyseen == 0)
+		keyseen = seen;
+}
+
+/* have the blocks in view that have changed drawn, or all of them if the
+   view has moved */
+void drawscreen(game_t *g)
+{
+	frame_t *f = &frames[filling];
+	size_t n = (size_t)(viewwidth * viewheight);
+	int r, c;
+
+	followblocks(g);
+	if (!makeroom(&view, &viewsize, n + 1)
+		|| !makeroom(&f->cells, &f->size, n + 1))
+	{
+		return;
+	}
+
+	/* the cells that have changed come 64 at a time, as bits */
+	for (r = viewtop; r < viewtop + viewheight; r++)
+	for (c = viewleft; c < viewleft + viewwidth; c += 64)
+	{
+		int k = viewleft + viewwidth - c < 64
+			? viewleft + viewwidth - c : 64;
+		uint64_t m = takechanges(g, r + HIDDEN_ROWS, c, k);
+
+		if (viewmoved)
+			m = k < 64 ? ((uint64_t)1 << k) - 1 : ~(uint64_t)0;
+		for (; m != 0; m &= m - 1)
+		{
+			int i = c + __builtin_ctzll(m);
+
+			view[(r - viewtop) * viewwidth + i - viewleft] =
+				shownblock(g, r + HIDDEN_ROWS, i);
+		}
+	}
+	viewmoved = 0;
+
+	(void)memcpy(f->cells, view, n);
+	f->borders  = borders;
+	f->width    = viewwidth;
+	f->height   = viewheight;
+	f->score    = g->score;
+	f->level    = g->level;
+	f->keyseen  = keyseen;
+	keyseen = 0;
+	publish();
+
+	if (rendering)
+	{
+		char ch = 0;
+		(void)write(wakepipe[1], &ch, 1);
+	}
+	else if ((f = takeframe()) != NULL)
+		showframe(f);
+}
+
+/* draw everything from scratch, after the screen has been messed up */
+void redrawscreen(game_t *g)
+{
+	drawborders(g->width, g->height - HIDDEN_ROWS);
+	drawscreen(g);
 }
 
 void updatescreen(void)
 {
-	(void)refresh();
+	if (ansi)
+		ansiflush();
+	else
+		(void)refresh();
+}
+
+/*
+	How many bytes have gone to the terminal so far, or -1 if there's
+no way to tell. curses writes straight to the terminal's file descriptor
+with no way to hook in, so for it this is every byte the calling thread
+has written, which the kernel keeps count of in /proc/thread-self/io (on
+Linux). Taken before and after a refresh on the same thread, the
+difference is what the refresh sent: the other threads' writes (keys
+recorded for a replay, wakeups through pipes) are counted apart. Without
+a count of the thread's own, there's no telling, rather than a count
+that takes in everybody's.
+*/
+long long screenbytes(void)
+{
+	char buf[512], *p;
+	ssize_t n;
+
+	if (ansi)
+		return ansibytes();
+
+	if (iofd == -2)
+		iofd = open("/proc/thread-self/io", O_RDONLY);
+	if (iofd < 0 || (n = pread(iofd, buf, sizeof buf - 1, 0)) <= 0)
+		return -1;
+	buf[n] = '\0';
+
+	if ((p = strstr(buf, "wchar:")) == NULL)
+		return -1;
+	return strtoll(p + 6, NULL, 10);
 }
@@ -0,0 +1,294 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+sim.c: columns-sim, playing lots of games with a computer player
+
+Game i is played from seed s+i, so a run gives the same results with
+any number of threads. The summary is printed as "name value" lines.
+*/
+
+#include "game.h"
+#include "pool.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LEVEL 10
+#define MAX_CHAIN 15 /* longer chain reactions are counted as this */
+
+typedef struct
+{
+	long games;
+	long score;
+	long minscore;
+	long maxscore;
+	long destroyed;
+	long ticks;
+	long pieces;
+	long unfinished;            /* games stopped at the tick limit */
+	long levels[MAX_LEVEL + 1]; /* games that ended on each level */
+	long chains[MAX_CHAIN + 1]; /* 1x3 blocks setting off n matches */
+	char pad[64];               /* keep threads' totals apart */
+} totals_t;
+
+typedef struct
+{
+	int width;
+	int height;
+	unsigned long seed;
+	long maxticks;
+	long games;
+	policy_t policy;
+	totals_t totals[MAX_WORKERS];
+} sim_t;
+
+/* with -l, each task is this many games played in lanes */
+#define LANE_GAMES (LANES * 8)
+
+/* where a game played in lanes goes */
+typedef struct
+{
+	sim_t *sim;
+	int worker;
+} lanetask_t;
+
+static void usage(void)
+{
+	(void)fprintf(stderr, "usage: columns-sim [-n games] [-j threads] "
+		"[-p random|greedy|lookahead]\n"
+		"                   [-l] [-s seed] [-t maxticks] [-w width] "
+		"[-h height]\n");
+	exit(1);
+}
+
+/* count one finished game in t */
+static void addgame(totals_t *t, long score, int level, long destroyed,
+	long ticks, long pieces, int over)
+{
+	if (t->games == 0 || score < t->minscore)
+		t->minscore = score;
+	if (t->games == 0 || score > t->maxscore)
+		t->maxscore = score;
+	t->games++;
+	t->score     += score;
+	t->destroyed += destroyed;
+	t->ticks     += ticks;
+	t->pieces    += pieces;
+	t->levels[level < MAX_LEVEL ? level : MAX_LEVEL]++;
+	if (!over)
+		t->unfinished++;
+}
+
+static void playone(long index, int worker, void *arg)
+{
+	sim_t *sim = arg;
+	totals_t *t = &sim->totals[worker];
+	uint64_t rng = (uint64_t)index * 2 + 1;
+	game_t *g;
+	move_t m;
+
+	if ((g = startgame(sim->width, sim->height,
+		sim->seed + (unsigned long)index)) == NULL)
+	{
+		(void)fprintf(stderr, "columns-sim: out of memory\n");
+		exit(1);
+	}
+	g->quickgravity = 1;
+
+	TRACE_BEGIN("game");
+	while (g->state != STATE_GAMEOVER && g->ticks < sim->maxticks)
+	{
+		TRACE_BEGIN("policy");
+		sim->policy(g, &rng, &m);
+		TRACE_END("policy");
+		playmove(g, &m);
+		t->chains[g->lastchain < MAX_CHAIN
+			? g->lastchain : MAX_CHAIN]++;
+	}
+	TRACE_END("game");
+
+	addgame(t, g->score, g->level, g->destroyed, g->ticks, g->pieces,
+		g->state == STATE_GAMEOVER);
+	endgame(g);
+}
+
+static void laneone(const laneresult_t *r, void *arg)
+{
+	lanetask_t *task = arg;
+	totals_t *t = &task->sim->totals[task->worker];
+	int i;
+
+	addgame(t, r->score, r->level, r->destroyed, r->ticks, r->pieces,
+		r->over);
+	for (i = 0; i < LANE_CHAINS; i++)
+		t->chains[i < MAX_CHAIN ? i : MAX_CHAIN] += r->chains[i];
+}
+
+/* with -l: games index*LANE_GAMES on, with the random policy */
+static void playlanegames(long index, int worker, void *arg)
+{
+	lanetask_t task;
+	long first = index * LANE_GAMES;
+
+	task.sim = arg;
+	task.worker = worker;
+	TRACE_BEGIN("lanes");
+	(void)playlanes(task.sim->width, task.sim->height, task.sim->seed,
+		first, task.sim->games - first < LANE_GAMES
+			? task.sim->games - first : LANE_GAMES,
+		task.sim->maxticks, laneone, &task);
+	TRACE_END("lanes");
+}
+
+/* add the totals of one thread into all */
+static void addtotals(totals_t *all, const totals_t *t)
+{
+	int i;
+
+	if (t->games == 0)
+		return;
+	if (all->games == 0 || t->minscore < all->minscore)
+		all->minscore = t->minscore;
+	if (all->games == 0 || t->maxscore > all->maxscore)
+		all->maxscore = t->maxscore;
+	all->games      += t->games;
+	all->score      += t->score;
+	all->destroyed  += t->destroyed;
+	all->ticks      += t->ticks;
+	all->pieces     += t->pieces;
+	all->unfinished += t->unfinished;
+	for (i = 0; i <= MAX_LEVEL; i++)
+		all->levels[i] += t->levels[i];
+	for (i = 0; i <= MAX_CHAIN; i++)
+		all->chains[i] += t->chains[i];
+}
+
+static void printhistogram(const char *name, const long *counts, int n)
+{
+	int i;
+
+	(void)printf("%s", name);
+	for (i = 0; i <= n; i++)
+	{
+		if (counts[i] != 0)
+			(void)printf(" %d:%ld", i, counts[i]);
+	}
+	(void)printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	static sim_t sim;
+	totals_t all;
+	struct timespec t0, t1;
+	double secs, n;
+	long games = 1000;
+	int threads = numprocessors();
+	const char *policyname = "random";
+	int lanes = 0;
+	int ch, i;
+
+	sim.width    = DEF_WIDTH;
+	sim.height   = DEF_HEIGHT;
+	sim.seed     = 1;
+	sim.maxticks = 100000;
+
+	while ((ch = getopt(argc, argv, "h:j:ln:p:s:t:w:")) != -1)
+	{
+		switch (ch)
+		{
+		case 'h':
+			sim.height = atoi(optarg);
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 'l':
+			lanes = 1;
+			break;
+		case 'n':
+			games = atol(optarg);
+			break;
+		case 'p':
+			policyname = optarg;
+			break;
+		case 's':
+			sim.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			sim.maxticks = atol(optarg);
+			break;
+		case 'w':
+			sim.width = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (sim.width < MIN_WIDTH || sim.width > BIG_MAX
+		|| sim.height < MIN_HEIGHT || sim.height > BIG_MAX
+		|| games < 1 || threads < 1)
+	{
+		usage();
+	}
+	if ((sim.policy = findpolicy(policyname)) == NULL)
+	{
+		(void)fprintf(stderr, "columns-sim: no policy called %s\n",
+			policyname);
+		exit(1);
+	}
+	if (strcmp(policyname, "random") != 0
+		&& (sim.width > MAX_WIDTH || sim.height > MAX_HEIGHT))
+	{
+		(void)fprintf(stderr, "columns-sim: only -p random plays "
+			"playfields bigger than %d by %d\n",
+			MAX_WIDTH, MAX_HEIGHT);
+		exit(1);
+	}
+	if (lanes && (strcmp(policyname, "random") != 0
+		|| sim.width > LANE_WIDTH || sim.height > MAX_HEIGHT))
+	{
+		(void)fprintf(stderr, "columns-sim: -l is only for -p random "
+			"and playfields up to %d by %d\n",
+			LANE_WIDTH, MAX_HEIGHT);
+		exit(1);
+	}
+	sim.games = games;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (lanes)
+		threads = runpool((games + LANE_GAMES - 1) / LANE_GAMES,
+			threads, playlanegames, &sim);
+	else
+		threads = runpool(games, threads, playone, &sim);
+	(void)clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (double)(t1.tv_sec - t0.tv_sec)
+		+ (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	(void)memset(&all, 0, sizeof all);
+	for (i = 0; i < threads; i++)
+		addtotals(&all, &sim.totals[i]);
+	n = (double)all.games;
+
+	(void)printf("policy %s\n", policyname);
+	(void)printf("games %ld\n", all.games);
+	(void)printf("unfinished %ld\n", all.unfinished);
+	(void)printf("threads %d\n", threads);
+	(void)printf("seconds %.3f\n", secs);
+	(void)printf("games_per_s %.1f\n", n / secs);
+	(void)printf("score_mean %.2f\n", (double)all.score / n);
+	(void)printf("score_min %ld\n", all.minscore);
+	(void)printf("score_max %ld\n", all.maxscore);
+	(void)printf("destroyed_mean %.2f\n", (double)all.destroyed / n);
+	(void)printf("pieces_mean %.2f\n", (double)all.pieces / n);
+	(void)printf("ticks_mean %.2f\n", (double)all.ticks / n);
+	printhistogram("levels", all.levels, MAX_LEVEL);
+	printhistogram("chains", all.chains, MAX_CHAIN);
+
+	TRACE_EXPORT();
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+stats.c: measuring what each frame costs
+*/
+
+#include "columns.h"
+
+/*
+	Each measurement goes into a histogram with eight buckets for
+every power of two, so any quantile read back from it is within about
+12% of the real value, whatever the range of values. The game's
+thread adds to one histogram while the drawing thread adds to the
+others and reads them all for the panel, so every count is read and
+written with relaxed atomics: a reading can be a measurement or two
+behind, but never torn.
+*/
+
+#define HIST_BUCKETS 496
+
+typedef struct
+{
+	long count;
+	long long sum;
+	long long max;
+	long buckets[HIST_BUCKETS];
+} hist_t;
+
+static const struct
+{
+	const char *name;
+	const char *unit;
+} measures[] =
+{
+	{ "sim",   "ns" }, /* STAT_SIM:   one gametick() */
+	{ "draw",  "ns" }, /* STAT_DRAW:  one frame drawn, with output */
+	{ "bytes", "B"  }, /* STAT_BYTES: sent to the terminal per frame */
+	{ "lag",   "ns" }, /* STAT_LAG:   from a key to the screen showing
+	                      what it did */
+	{ "wait",  "ns" }  /* STAT_WAIT:  a frame held back for a slow
+	                      terminal */
+};
+
+#define NUMHISTS ((int)(sizeof measures / sizeof measures[0]))
+
+static hist_t hists[NUMHISTS];
+
+static int bucketof(long long v)
+{
+	int lg;
+
+	if (v < 8)
+		return v < 0 ? 0 : (int)v;
+	lg = 63 - __builtin_clzll((unsigned long long)v);
+	return (lg - 2) * 8 + (int)((v >> (lg - 3)) & 7);
+}
+
+/* the smallest value that goes in bucket b */
+static long long bucketlow(int b)
+{
+	if (b < 8)
+		return b;
+	return (long long)(8 + b % 8) << (b / 8 - 1);
+}
+
+void statadd(int which, long long v)
+{
+	hist_t *h = &hists[which];
+	long long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	(void)__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	(void)__atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+	while (v > max && !__atomic_compare_exchange_n(&h->max, &max, v, 1,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		;
+	}
+	(void)__atomic_fetch_add(&h->buckets[bucketof(v)], 1,
+		__ATOMIC_RELAXED);
+}
+
+/* roughly the value that a fraction q of the measurements are below */
+static long long quantile(const hist_t *h, double q)
+{
+	long want = (long)(q * (double)__atomic_load_n(&h->count,
+		__ATOMIC_RELAXED));
+	long seen = 0;
+	int b;
+
+	for (b = 0; b < HIST_BUCKETS; b++)
+	{
+		seen += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+		if (seen > want)
+			return bucketlow(b);
+	}
+	return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+/* v, in unit, in at most 6 characters */
+static void shortvalue(char *buf, size_t size, long long v, const char *unit)
+{
+	if (strcmp(unit, "ns") != 0)
+		(void)snprintf(buf, size, "%lld%s", v, unit);
+	else if (v < 10000)
+		(void)snprintf(buf, size, "%lldns", v);
+	else if (v < 10000000)
+		(void)snprintf(buf, size, "%lldus", v / 1000);
+	else
+		(void)snprintf(buf, size, "%lldms", v / 1000000);
+}
+
+/* show the median of each measurement in the panel beside the
+   playfield */
+void drawstats(void)
+{
+	char value[24], line[40];
+	int i;
+
+	for (i = 0; i < NUMHISTS; i++)
+	{
+		shortvalue(value, sizeof value, quantile(&hists[i], 0.5),
+			measures[i].unit);
+		(void)snprintf(line, sizeof line, "%-5s%7s",
+			measures[i].name, value);
+		drawpanelline(i, line);
+	}
+}
+
+/* write a summary of every measurement into buf */
+void statsreport(char *buf, size_t size)
+{
+	size_t len;
+	int i;
+
+	len = (size_t)snprintf(buf, size, "%-6s %8s %10s %10s %10s %10s %10s",
+		"", "count", "mean", "p50", "p90", "p99", "max");
+
+	for (i = 0; i < NUMHISTS && len < size; i++)
+	{
+		const hist_t *h = &hists[i];
+		long count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+		long long sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+
+		len += (size_t)snprintf(buf + len, size - len,
+			"\n%-6s %8ld %10lld %10lld %10lld %10lld %10lld %s",
+			measures[i].name, count, count > 0 ? sum / count : 0,
+			quantile(h, 0.5), quantile(h, 0.9), quantile(h, 0.99),
+			__atomic_load_n(&h->max, __ATOMIC_RELAXED),
+			measures[i].unit);
+	}
+}
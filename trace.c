@@ -0,0 +1,222 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+trace.c: recording spans for trace.h
+*/
+
+#ifdef TRACE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+/*
+	Every thread that records anything gets a ring of its own, so
+recording takes no locks and threads never share a cache line; when a
+ring fills up the oldest events are written over. An event is just the
+span's name (always a string constant), the time and whether it's the
+start or end of the span.
+
+	runpool() starts new threads all the time, so when a thread exits
+its ring goes on a free list (by way of a thread-specific key's
+destructor), and the next thread to need one carries on in it, under
+the same tid. Only as many rings as there have been threads at once
+get made.
+
+	On x86 the time is the processor's timestamp counter, which is
+much quicker to read than the clock. It is turned into microseconds
+when the trace is written, by comparing how far it and the monotonic
+clock have moved since the first event.
+*/
+
+#define RING_SIZE 65536 /* events kept per thread */
+#define MAX_RINGS 512
+
+#define TRACE_FILE "columns-trace.json" /* unless $COLUMNS_TRACE says */
+
+typedef struct
+{
+	const char *name;
+	uint64_t time;
+	char phase;       /* 'B' for the start of a span, 'E' for the end */
+} event_t;
+
+typedef struct ring
+{
+	int tid;
+	unsigned long count; /* events recorded, including lost ones */
+	struct ring *next;   /* in the free list */
+	event_t events[RING_SIZE];
+} ring_t;
+
+static ring_t *rings[MAX_RINGS];
+static int numrings;
+
+static ring_t *freerings;    /* rings of threads that have exited */
+static pthread_mutex_t freelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ringkey;
+static pthread_once_t ringonce = PTHREAD_ONCE_INIT;
+
+static __thread ring_t *ring;
+static __thread int noring;  /* couldn't have one; don't try again */
+
+static uint64_t starttime;   /* ticks() at the first event */
+static long long startns;    /* the monotonic clock then */
+
+static long long clockns(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return (uint64_t)clockns();
+#endif
+}
+
+/* a thread with a ring has exited; let the next one have it */
+static void putring(void *r)
+{
+	(void)pthread_mutex_lock(&freelock);
+	((ring_t *)r)->next = freerings;
+	freerings = r;
+	(void)pthread_mutex_unlock(&freelock);
+}
+
+static void makeringkey(void)
+{
+	(void)pthread_key_create(&ringkey, putring);
+}
+
+/* give this thread a ring; return 0 if there are no more to be had */
+static int getring(void)
+{
+	int i;
+
+	if (noring)
+		return 0;
+	(void)pthread_once(&ringonce, makeringkey);
+
+	(void)pthread_mutex_lock(&freelock);
+	if ((ring = freerings) != NULL)
+		freerings = ring->next;
+	(void)pthread_mutex_unlock(&freelock);
+	if (ring != NULL)
+	{
+		(void)pthread_setspecific(ringkey, ring);
+		return 1;
+	}
+
+	if ((ring = calloc(1, sizeof *ring)) == NULL
+		|| (i = __sync_fetch_and_add(&numrings, 1)) >= MAX_RINGS)
+	{
+		free(ring);
+		ring = NULL;
+		noring = 1;
+		return 0;
+	}
+
+	if (i == 0)
+	{
+		startns = clockns();
+		starttime = ticks();
+	}
+	ring->tid = i;
+	__sync_synchronize();
+	rings[i] = ring;
+	(void)pthread_setspecific(ringkey, ring);
+	return 1;
+}
+
+static void record(const char *name, char phase)
+{
+	event_t *e;
+
+	if (ring == NULL && !getring())
+		return;
+
+	e = &ring->events[ring->count++ % RING_SIZE];
+	e->name = name;
+	e->phase = phase;
+	e->time = ticks();
+}
+
+void tracebegin(const char *name)
+{
+	record(name, 'B');
+}
+
+void traceend(const char *name)
+{
+	record(name, 'E');
+}
+
+/* write one thread's events, oldest first, leaving out the ends of
+   spans whose starts were written over */
+static void exportring(FILE *f, const ring_t *r, double usperticks,
+	int *first)
+{
+	unsigned long i = r->count > RING_SIZE ? r->count - RING_SIZE : 0;
+	int depth = 0;
+
+	for (; i < r->count; i++)
+	{
+		const event_t *e = &r->events[i % RING_SIZE];
+
+		if (e->phase == 'B')
+			depth++;
+		else if (depth == 0)
+			continue;
+		else
+			depth--;
+
+		(void)fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\","
+			"\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+			*first ? "" : ",\n", e->name, e->phase,
+			(double)(int64_t)(e->time - starttime) * usperticks,
+			r->tid);
+		*first = 0;
+	}
+}
+
+/* write the trace to $COLUMNS_TRACE, or TRACE_FILE; any other threads
+   should have stopped recording by now */
+void traceexport(void)
+{
+	const char *file = getenv("COLUMNS_TRACE");
+	uint64_t now = ticks();
+	double usperticks;
+	FILE *f;
+	int i, n, first = 1;
+
+	if (file == NULL)
+		file = TRACE_FILE;
+	if ((n = numrings) == 0 || (f = fopen(file, "w")) == NULL)
+		return;
+	if (n > MAX_RINGS)
+		n = MAX_RINGS;
+
+	usperticks = (double)(clockns() - startns) / 1000.0;
+	if (now != starttime)
+		usperticks /= (double)(now - starttime);
+
+	(void)fprintf(f, "{\"traceEvents\":[\n");
+	for (i = 0; i < n; i++)
+	{
+		if (rings[i] != NULL)
+			exportring(f, rings[i], usperticks, &first);
+	}
+	(void)fprintf(f, "\n]}\n");
+	(void)fclose(f);
+}
+
+#endif
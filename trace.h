@@ -0,0 +1,33 @@
+/*
+This file is public domain; anyone may deal in it without restriction.
+
+trace.h: optional tracing of the game's states and inner loops
+
+Built with TRACE defined ("make TRACE=1"), TRACE_BEGIN() and TRACE_END()
+mark where a named span of time starts and ends, and TRACE_EXPORT()
+writes every span recorded so far to a file that chrome://tracing or
+Perfetto can show. Without TRACE they all compile to nothing.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef TRACE
+
+void tracebegin(const char *name);
+void traceend(const char *name);
+void traceexport(void);
+
+#define TRACE_BEGIN(name) tracebegin(name)
+#define TRACE_END(name)   traceend(name)
+#define TRACE_EXPORT()    traceexport()
+
+#else
+
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name)   ((void)0)
+#define TRACE_EXPORT()    ((void)0)
+
+#endif
+
+#endif